@@ -0,0 +1,235 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Channel quality table fed by the uplink outcomes, biasing the
+             uplink channel choice
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "ChannelQuality.h"
+
+/*!
+ * EWMA weight of an uplink outcome, 1/2^n
+ */
+#define CHANNEL_QUALITY_SHIFT                       3
+
+/*!
+ * Random choices of the greedy policy, one uplink in 2^n
+ */
+#define CHANNEL_QUALITY_EXPLORE_SHIFT               3
+
+static ChannelQuality_t ChannelQualityTable[CHANNEL_QUALITY_NB_CHANNELS];
+
+static const ChannelQualityPolicy_t *ChannelQualityPolicy;
+
+/*!
+ * Channel of the last uplink, -1 when its outcome is recorded
+ */
+static int8_t ChannelQualityLastChannel = -1;
+
+/*!
+ * A downlink was received for the last uplink
+ */
+static bool ChannelQualityDownlink = false;
+
+/*!
+ * \brief Selection weight of a candidate channel [1/256]
+ */
+static uint32_t ChannelQualityWeight( const ChannelQuality_t *table, const uint16_t *budget, uint8_t channel )
+{
+    uint32_t score = table[channel].Score;
+    // Squared, a channel delivering 60 % is chosen 2.5 times less than one
+    // delivering 95 %
+    uint32_t weight = ( score * score ) >> 8;
+
+    if( budget != NULL )
+    {
+        weight = ( weight * budget[channel] ) >> 8;
+    }
+    return MAX( weight, CHANNEL_QUALITY_MIN_WEIGHT );
+}
+
+/*!
+ * \brief Picks the n-th candidate channel
+ */
+static int8_t ChannelQualityNth( uint16_t candidates, uint8_t n )
+{
+    uint8_t i;
+
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        if( ( candidates & ( 1 << i ) ) != 0 )
+        {
+            if( n == 0 )
+            {
+                return i;
+            }
+            n--;
+        }
+    }
+    return -1;
+}
+
+static uint8_t ChannelQualityCount( uint16_t candidates )
+{
+    uint8_t count = 0;
+
+    while( candidates != 0 )
+    {
+        candidates &= candidates - 1;
+        count++;
+    }
+    return count;
+}
+
+static int8_t ChannelQualitySelectUniform( const ChannelQuality_t *table, uint16_t candidates, const uint16_t *budget )
+{
+    ( void )table;
+    ( void )budget;
+    return ChannelQualityNth( candidates, randr( 0, ChannelQualityCount( candidates ) - 1 ) );
+}
+
+static int8_t ChannelQualitySelectWeighted( const ChannelQuality_t *table, uint16_t candidates, const uint16_t *budget )
+{
+    uint32_t total = 0;
+    int32_t pick;
+    uint8_t i;
+
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        if( ( candidates & ( 1 << i ) ) != 0 )
+        {
+            total += ChannelQualityWeight( table, budget, i );
+        }
+    }
+    pick = randr( 0, total - 1 );
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        if( ( candidates & ( 1 << i ) ) != 0 )
+        {
+            pick -= ChannelQualityWeight( table, budget, i );
+            if( pick < 0 )
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static int8_t ChannelQualitySelectGreedy( const ChannelQuality_t *table, uint16_t candidates, const uint16_t *budget )
+{
+    uint32_t best = 0;
+    uint32_t weight;
+    int8_t channel = -1;
+    uint8_t i;
+
+    if( randr( 0, ( 1 << CHANNEL_QUALITY_EXPLORE_SHIFT ) - 1 ) == 0 )
+    {
+        return ChannelQualitySelectUniform( table, candidates, budget );
+    }
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        if( ( candidates & ( 1 << i ) ) == 0 )
+        {
+            continue;
+        }
+        // Ties broken at random, not always the lowest channel
+        weight = ( ChannelQualityWeight( table, budget, i ) << 4 ) + randr( 0, 15 );
+        if( weight > best )
+        {
+            best = weight;
+            channel = i;
+        }
+    }
+    return channel;
+}
+
+const ChannelQualityPolicy_t ChannelQualityPolicyUniform = { "uniform", ChannelQualitySelectUniform };
+const ChannelQualityPolicy_t ChannelQualityPolicyWeighted = { "weighted", ChannelQualitySelectWeighted };
+const ChannelQualityPolicy_t ChannelQualityPolicyGreedy = { "greedy", ChannelQualitySelectGreedy };
+
+void ChannelQualityInit( const ChannelQualityPolicy_t *policy )
+{
+    uint8_t i;
+
+    memset1( ( uint8_t* )ChannelQualityTable, 0, sizeof( ChannelQualityTable ) );
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        ChannelQualityTable[i].Score = CHANNEL_QUALITY_INITIAL_SCORE;
+    }
+    ChannelQualityPolicy = policy;
+    ChannelQualityLastChannel = -1;
+    ChannelQualityDownlink = false;
+}
+
+void ChannelQualitySetPolicy( const ChannelQualityPolicy_t *policy )
+{
+    ChannelQualityPolicy = policy;
+}
+
+const ChannelQualityPolicy_t *ChannelQualityGetPolicy( void )
+{
+    return ChannelQualityPolicy;
+}
+
+int8_t ChannelQualitySelect( uint16_t candidates, const uint16_t *budget )
+{
+    if( candidates == 0 )
+    {
+        return -1;
+    }
+    return ChannelQualityPolicy->Select( ChannelQualityTable, candidates, budget );
+}
+
+void ChannelQualityOnTx( int8_t channel )
+{
+    ChannelQualityLastChannel = channel;
+    ChannelQualityDownlink = false;
+    if( ( channel >= 0 ) && ( channel < CHANNEL_QUALITY_NB_CHANNELS ) )
+    {
+        ChannelQualityTable[channel].Uplinks++;
+    }
+}
+
+void ChannelQualityOnDownlink( void )
+{
+    ChannelQualityDownlink = true;
+}
+
+void ChannelQualityOnConfirm( bool confirmed, bool acked )
+{
+    ChannelQuality_t *quality;
+    bool delivered = acked || ChannelQualityDownlink;
+
+    if( ( ChannelQualityLastChannel < 0 ) || ( ChannelQualityLastChannel >= CHANNEL_QUALITY_NB_CHANNELS ) )
+    {
+        return;
+    }
+    if( ( confirmed == true ) || ( delivered == true ) )
+    {
+        quality = &ChannelQualityTable[ChannelQualityLastChannel];
+        if( delivered == true )
+        {
+            quality->Delivered++;
+        }
+        quality->Score += ( ( delivered ? 256 : 0 ) - ( int32_t )quality->Score ) / ( 1 << CHANNEL_QUALITY_SHIFT );
+    }
+    ChannelQualityLastChannel = -1;
+}
+
+void ChannelQualityGet( uint8_t channel, ChannelQuality_t *quality )
+{
+    if( channel < CHANNEL_QUALITY_NB_CHANNELS )
+    {
+        *quality = ChannelQualityTable[channel];
+    }
+}
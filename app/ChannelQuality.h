@@ -0,0 +1,147 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Channel quality table fed by the uplink outcomes, biasing the
+             uplink channel choice
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __CHANNEL_QUALITY_H__
+#define __CHANNEL_QUALITY_H__
+
+#include "board.h"
+
+/*!
+ * Channels of the table, LORA_MAX_NB_CHANNELS of the MAC layer
+ */
+#define CHANNEL_QUALITY_NB_CHANNELS                 16
+
+/*!
+ * Delivery score of a channel never used, optimistic so that every channel
+ * is tried [1/256]
+ */
+#ifndef CHANNEL_QUALITY_INITIAL_SCORE
+#define CHANNEL_QUALITY_INITIAL_SCORE               256
+#endif
+
+/*!
+ * Smallest selection weight of a candidate channel, keeping the channels
+ * of low score explored so that their recovery is noticed [1/256]
+ */
+#ifndef CHANNEL_QUALITY_MIN_WEIGHT
+#define CHANNEL_QUALITY_MIN_WEIGHT                  8
+#endif
+
+/*!
+ * Quality of a channel
+ */
+typedef struct sChannelQuality
+{
+    uint32_t Uplinks;                           // Uplinks sent on the channel
+    uint32_t Delivered;                         // Uplinks acknowledged or answered
+    uint16_t Score;                             // EWMA of the delivery [1/256]
+}ChannelQuality_t;
+
+/*!
+ * Channel selection policy
+ */
+typedef struct sChannelQualityPolicy
+{
+    const char *Name;
+    /*!
+     * \brief Selects the channel of the next uplink
+     *
+     * \param [IN] table      Quality of the channels
+     * \param [IN] candidates Mask of the channels allowed
+     * \param [IN] budget     Duty cycle budget weight of each channel [1/256]
+     * \retval channel        Selected channel, one of the candidates
+     */
+    int8_t ( *Select )( const ChannelQuality_t *table, uint16_t candidates, const uint16_t *budget );
+}ChannelQualityPolicy_t;
+
+/*!
+ * Policy of the MAC layer: uniform choice among the candidates
+ */
+extern const ChannelQualityPolicy_t ChannelQualityPolicyUniform;
+
+/*!
+ * Choice at random, weighted by the squared delivery score and by the duty
+ * cycle budget
+ */
+extern const ChannelQualityPolicy_t ChannelQualityPolicyWeighted;
+
+/*!
+ * Channel of the best weight, one uplink in eight at random among the
+ * candidates
+ */
+extern const ChannelQualityPolicy_t ChannelQualityPolicyGreedy;
+
+/*!
+ * \brief Initializes the table, all the channels at the initial score
+ *
+ * \param [IN] policy Channel selection policy
+ */
+void ChannelQualityInit( const ChannelQualityPolicy_t *policy );
+
+/*!
+ * \brief Changes the channel selection policy, the table is kept
+ *
+ * \param [IN] policy Channel selection policy
+ */
+void ChannelQualitySetPolicy( const ChannelQualityPolicy_t *policy );
+
+/*!
+ * \brief Gets the channel selection policy
+ *
+ * \retval policy Channel selection policy
+ */
+const ChannelQualityPolicy_t *ChannelQualityGetPolicy( void );
+
+/*!
+ * \brief Selects the channel of the next uplink through the policy
+ *
+ * \param [IN] candidates Mask of the channels allowed
+ * \param [IN] budget     Duty cycle budget weight of each channel [1/256],
+ *                        NULL when all the channels have the same
+ * \retval channel        Selected channel, -1 without candidate
+ */
+int8_t ChannelQualitySelect( uint16_t candidates, const uint16_t *budget );
+
+/*!
+ * \brief Records the channel of an uplink
+ *
+ * \param [IN] channel Channel of the uplink
+ */
+void ChannelQualityOnTx( int8_t channel );
+
+/*!
+ * \brief Records a downlink received in the receive windows of the last
+ *        uplink, which was then delivered
+ */
+void ChannelQualityOnDownlink( void );
+
+/*!
+ * \brief Records the outcome of the last uplink. An unconfirmed uplink
+ *        without downlink has no outcome.
+ *
+ * \param [IN] confirmed The uplink was confirmed
+ * \param [IN] acked     The confirmed uplink was acknowledged
+ */
+void ChannelQualityOnConfirm( bool confirmed, bool acked );
+
+/*!
+ * \brief Gets the quality of a channel
+ *
+ * \param [IN]  channel Channel index
+ * \param [OUT] quality Quality of the channel
+ */
+void ChannelQualityGet( uint8_t channel, ChannelQuality_t *quality );
+
+#endif // __CHANNEL_QUALITY_H__
@@ -0,0 +1,186 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host simulation of the channel selection policies: packet
+             delivery ratio on a lineup of unequally noisy channels
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+
+The simulated uplinks are counted, not timed, so only the board.h of
+host/ is needed. From the repository root, with CHANNEL_QUALITY_BENCHMARK
+defined to keep the file out of the firmware:
+
+    g++ -O2 -DCHANNEL_QUALITY_BENCHMARK -Ihost -I. -Isystem -Iapp \
+        app/ChannelQualityBench.cpp app/ChannelQuality.cpp \
+        system/utilities.cpp -o channel_bench
+
+    ./channel_bench [options]
+
+Every policy sends the same number of confirmed uplinks on the same
+channels, each uplink delivered, and acknowledged, with the delivery
+probability of its channel. The channel outcomes are drawn from a generator
+of their own with the same seed for every policy. The duty cycle budget is
+the same on all the channels, as on the default lineup LC1 - LC8 at 1 %.
+Options:
+
+    --uplinks N        uplinks per policy, default 10000
+    --pdr P,P,...      delivery probability of each channel, default
+                       0.95,0.95,0.95,0.95,0.6,0.95,0.4,0.95
+    --rotate N         every N uplinks the probabilities move by one
+                       channel, for a changing interference, default never
+    --seed S           seed of the generators, default 1
+*/
+#if defined( CHANNEL_QUALITY_BENCHMARK )
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "ChannelQuality.h"
+
+typedef struct
+{
+    uint32_t Uplinks;
+    uint32_t Delivered;
+    uint32_t PerChannel[CHANNEL_QUALITY_NB_CHANNELS];
+}BenchResult_t;
+
+static const ChannelQualityPolicy_t *const BenchPolicies[] =
+{
+    &ChannelQualityPolicyUniform,
+    &ChannelQualityPolicyWeighted,
+    &ChannelQualityPolicyGreedy
+};
+
+#define BENCH_POLICIES              ( sizeof( BenchPolicies ) / sizeof( BenchPolicies[0] ) )
+
+/*!
+ * Channel outcome generator, xorshift32
+ */
+static uint32_t BenchState;
+
+static double BenchRandom( void )
+{
+    BenchState ^= BenchState << 13;
+    BenchState ^= BenchState >> 17;
+    BenchState ^= BenchState << 5;
+    return ( double )BenchState / 4294967296.0;
+}
+
+static void BenchRun( const ChannelQualityPolicy_t *policy, const double *pdr, uint8_t nbChannels,
+                      uint32_t uplinks, uint32_t rotate, uint32_t seed, BenchResult_t *result )
+{
+    uint16_t candidates = ( 1 << nbChannels ) - 1;
+    uint32_t n;
+    int8_t channel;
+    bool delivered;
+
+    memset( result, 0, sizeof( BenchResult_t ) );
+    srand1( seed );
+    BenchState = seed;
+    ChannelQualityInit( policy );
+    for( n = 0; n < uplinks; n++ )
+    {
+        channel = ChannelQualitySelect( candidates, NULL );
+        ChannelQualityOnTx( channel );
+        delivered = BenchRandom( ) < pdr[( channel + ( ( rotate != 0 ) ? n / rotate : 0 ) ) % nbChannels];
+        ChannelQualityOnConfirm( true, delivered );
+        result->Uplinks++;
+        result->Delivered += delivered;
+        result->PerChannel[channel]++;
+    }
+}
+
+static void Usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [--uplinks N] [--pdr P,P,...] [--rotate N] [--seed S]\n", name );
+}
+
+int main( int argc, char **argv )
+{
+    double pdr[CHANNEL_QUALITY_NB_CHANNELS] = { 0.95, 0.95, 0.95, 0.95, 0.6, 0.95, 0.4, 0.95 };
+    uint8_t nbChannels = 8;
+    uint32_t uplinks = 10000;
+    uint32_t rotate = 0;
+    uint32_t seed = 1;
+    BenchResult_t result;
+    double reference = 0.0;
+    double ratio;
+    uint8_t p, i;
+    int a;
+
+    for( a = 1; a < argc; a++ )
+    {
+        if( ( strcmp( argv[a], "--uplinks" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            uplinks = strtoul( argv[++a], NULL, 0 );
+        }
+        else if( ( strcmp( argv[a], "--pdr" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            char *list = argv[++a];
+            char *end;
+
+            for( nbChannels = 0; ( nbChannels < CHANNEL_QUALITY_NB_CHANNELS ) && ( *list != '\0' ); nbChannels++ )
+            {
+                pdr[nbChannels] = strtod( list, &end );
+                if( end == list )
+                {
+                    break;
+                }
+                list = ( *end == ',' ) ? end + 1 : end;
+            }
+        }
+        else if( ( strcmp( argv[a], "--rotate" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            rotate = strtoul( argv[++a], NULL, 0 );
+        }
+        else if( ( strcmp( argv[a], "--seed" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            seed = strtoul( argv[++a], NULL, 0 );
+        }
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+    if( ( nbChannels == 0 ) || ( uplinks == 0 ) || ( seed == 0 ) )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    printf( "channels %u, uplinks %u, rotate %u, delivery probability", nbChannels, uplinks, rotate );
+    for( i = 0; i < nbChannels; i++ )
+    {
+        printf( " %.2f", pdr[i] );
+    }
+    printf( "\n" );
+    for( p = 0; p < BENCH_POLICIES; p++ )
+    {
+        BenchRun( BenchPolicies[p], pdr, nbChannels, uplinks, rotate, seed, &result );
+        ratio = ( double )result.Delivered / result.Uplinks;
+        if( p == 0 )
+        {
+            reference = ratio;
+        }
+        printf( "%-10s PDR %6.2f %%  gain %+6.2f points (%+6.2f %%)  share", BenchPolicies[p]->Name,
+                100.0 * ratio, 100.0 * ( ratio - reference ), 100.0 * ( ratio / reference - 1.0 ) );
+        for( i = 0; i < nbChannels; i++ )
+        {
+            printf( " %4.1f", 100.0 * result.PerChannel[i] / result.Uplinks );
+        }
+        printf( "\n" );
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif // CHANNEL_QUALITY_BENCHMARK
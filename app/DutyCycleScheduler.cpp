@@ -0,0 +1,287 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Uplink scheduler keeping the ETSI duty cycle of each EU868
+             sub-band
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "LoRaMac.h"
+#include "DutyCycleScheduler.h"
+
+#if defined( USE_BAND_868 )
+
+/*
+ * The ledger follows the rule the MAC layer enforces: after a transmission
+ * of ToA in a band of duty cycle 1 / DCycle, the band is off for
+ * ToA * ( DCycle - 1 ). Before each uplink the channel mask is restricted
+ * to one free band, so the ledger knows the band the MAC layer picks a
+ * channel in, and the MAC layer never has to delay or refuse the frame.
+ */
+
+/*!
+ * Inverse of the duty cycle of the sub-bands, as the MAC layer bands
+ */
+static const uint16_t DutyCycleBandDCycle[DUTY_CYCLE_BANDS] = { 100, 100, 1000, 10, 100 };
+
+static DutyCycleBand_t DutyCycleBands[DUTY_CYCLE_BANDS];
+
+/*!
+ * Channel mask set by the network (join, LinkADRReq), and the mask last set
+ * by the scheduler
+ */
+static uint16_t DutyCycleBaseMask;
+static uint16_t DutyCycleSteerMask;
+
+/*!
+ * Band of the last uplink
+ */
+static int8_t DutyCycleLastBand = -1;
+
+/*!
+ * \brief Gets the channels of the MAC layer and the mask they may be used
+ *        in, following the network changes of the mask
+ */
+static ChannelParams_t *DutyCycleGetChannels( uint16_t *mask )
+{
+    MibRequestConfirm_t mibReq;
+
+    mibReq.Type = MIB_CHANNELS_MASK;
+    LoRaMacMibGetRequestConfirm( &mibReq );
+    if( mibReq.Param.ChannelsMask[0] != DutyCycleSteerMask )
+    {
+        // Changed behind the scheduler
+        DutyCycleBaseMask = mibReq.Param.ChannelsMask[0];
+        DutyCycleSteerMask = DutyCycleBaseMask;
+    }
+    *mask = DutyCycleBaseMask;
+
+    mibReq.Type = MIB_CHANNELS;
+    LoRaMacMibGetRequestConfirm( &mibReq );
+    return mibReq.Param.ChannelList;
+}
+
+/*!
+ * \brief Computes the mask of the bands having an enabled channel which
+ *        supports the datarate
+ */
+static uint8_t DutyCycleGetBands( int8_t datarate, uint16_t *channelMask )
+{
+    ChannelParams_t *channels = DutyCycleGetChannels( channelMask );
+    uint8_t bands = 0;
+    uint8_t i;
+
+    for( i = 0; i < LORA_MAX_NB_CHANNELS; i++ )
+    {
+        if( ( ( *channelMask & ( 1 << i ) ) == 0 ) || ( channels[i].Frequency == 0 ) ||
+            ( channels[i].Band >= DUTY_CYCLE_BANDS ) )
+        {
+            continue;
+        }
+        if( ( datarate >= channels[i].DrRange.Fields.Min ) && ( datarate <= channels[i].DrRange.Fields.Max ) )
+        {
+            bands |= 1 << channels[i].Band;
+        }
+    }
+    return bands;
+}
+
+void DutyCycleSchedulerInit( void )
+{
+    MibRequestConfirm_t mibReq;
+    uint8_t i;
+
+    memset1( ( uint8_t* )DutyCycleBands, 0, sizeof( DutyCycleBands ) );
+    for( i = 0; i < DUTY_CYCLE_BANDS; i++ )
+    {
+        DutyCycleBands[i].DCycle = DutyCycleBandDCycle[i];
+    }
+    mibReq.Type = MIB_CHANNELS_MASK;
+    LoRaMacMibGetRequestConfirm( &mibReq );
+    DutyCycleBaseMask = mibReq.Param.ChannelsMask[0];
+    DutyCycleSteerMask = DutyCycleBaseMask;
+    DutyCycleLastBand = -1;
+}
+
+TimerTime_t DutyCycleSchedulerGetSendTime( int8_t datarate, TimerTime_t now )
+{
+    uint16_t channelMask;
+    uint8_t bands = DutyCycleGetBands( datarate, &channelMask );
+    TimerTime_t sendTime = 0;
+    bool found = false;
+    uint8_t i;
+
+    for( i = 0; i < DUTY_CYCLE_BANDS; i++ )
+    {
+        if( ( bands & ( 1 << i ) ) == 0 )
+        {
+            continue;
+        }
+        // A band never used is ready at 0
+        if( ( found == false ) || ( DutyCycleBands[i].ReadyTime < sendTime ) )
+        {
+            sendTime = DutyCycleBands[i].ReadyTime;
+            found = true;
+        }
+    }
+    // No band for the datarate: leave the decision to the MAC layer
+    return MAX( sendTime, now );
+}
+
+/*!
+ * \brief Restricts the MAC layer channel mask
+ */
+static void DutyCycleSetMask( uint16_t mask )
+{
+    MibRequestConfirm_t mibReq;
+
+    DutyCycleSteerMask = mask;
+    mibReq.Type = MIB_CHANNELS_MASK;
+    mibReq.Param.ChannelsMask = &DutyCycleSteerMask;
+    LoRaMacMibSetRequestConfirm( &mibReq );
+}
+
+int8_t DutyCycleSchedulerSteer( int8_t datarate, TimerTime_t now )
+{
+    ChannelParams_t *channels;
+    uint16_t channelMask;
+    uint16_t mask = 0;
+    uint8_t bands = DutyCycleGetBands( datarate, &channelMask );
+    int8_t band = -1;
+    uint8_t i;
+
+    // Free band of the highest duty cycle, the shortest off time after use
+    for( i = 0; i < DUTY_CYCLE_BANDS; i++ )
+    {
+        if( ( ( bands & ( 1 << i ) ) == 0 ) || ( DutyCycleBands[i].ReadyTime > now ) )
+        {
+            continue;
+        }
+        if( ( band < 0 ) || ( DutyCycleBands[i].DCycle < DutyCycleBands[band].DCycle ) )
+        {
+            band = i;
+        }
+    }
+    if( band < 0 )
+    {
+        return -1;
+    }
+
+    channels = DutyCycleGetChannels( &channelMask );
+    for( i = 0; i < LORA_MAX_NB_CHANNELS; i++ )
+    {
+        if( ( ( channelMask & ( 1 << i ) ) != 0 ) && ( channels[i].Frequency != 0 ) && ( channels[i].Band == band ) )
+        {
+            mask |= 1 << i;
+        }
+    }
+    DutyCycleSetMask( mask );
+    return band;
+}
+
+uint16_t DutyCycleSchedulerGetChannels( int8_t datarate, TimerTime_t now, uint16_t *budget )
+{
+    uint16_t channelMask;
+    ChannelParams_t *channels = DutyCycleGetChannels( &channelMask );
+    DutyCycleBand_t *band;
+    uint16_t candidates = 0;
+    uint8_t i;
+
+    for( i = 0; i < LORA_MAX_NB_CHANNELS; i++ )
+    {
+        if( ( ( channelMask & ( 1 << i ) ) == 0 ) || ( channels[i].Frequency == 0 ) ||
+            ( channels[i].Band >= DUTY_CYCLE_BANDS ) ||
+            ( datarate < channels[i].DrRange.Fields.Min ) || ( datarate > channels[i].DrRange.Fields.Max ) )
+        {
+            continue;
+        }
+        band = &DutyCycleBands[channels[i].Band];
+        if( band->ReadyTime > now )
+        {
+            continue;
+        }
+        candidates |= 1 << i;
+        // Full weight from 1 %, the off time after a 0.1 % band use is ten
+        // times longer
+        budget[i] = MIN( 256, 25600 / band->DCycle );
+    }
+    return candidates;
+}
+
+int8_t DutyCycleSchedulerSteerChannel( int8_t channel )
+{
+    uint16_t channelMask;
+    ChannelParams_t *channels = DutyCycleGetChannels( &channelMask );
+
+    if( ( channel < 0 ) || ( channel >= LORA_MAX_NB_CHANNELS ) || ( channels[channel].Band >= DUTY_CYCLE_BANDS ) )
+    {
+        return -1;
+    }
+    DutyCycleSetMask( 1 << channel );
+    return channels[channel].Band;
+}
+
+void DutyCycleSchedulerRelease( void )
+{
+    uint16_t channelMask;
+
+    DutyCycleGetChannels( &channelMask );
+    if( DutyCycleSteerMask != DutyCycleBaseMask )
+    {
+        DutyCycleSetMask( DutyCycleBaseMask );
+    }
+    DutyCycleLastBand = -1;
+}
+
+void DutyCycleSchedulerOnTx( int8_t band, uint32_t timeOnAir, TimerTime_t now )
+{
+    DutyCycleBand_t *entry;
+
+    DutyCycleLastBand = band;
+    if( ( band < 0 ) || ( band >= DUTY_CYCLE_BANDS ) )
+    {
+        return;
+    }
+    entry = &DutyCycleBands[band];
+    entry->ReadyTime = now + ( TimerTime_t )timeOnAir * entry->DCycle;
+    entry->Airtime += timeOnAir;
+    entry->Uplinks++;
+}
+
+void DutyCycleSchedulerOnConfirm( uint32_t timeOnAir, TimerTime_t now )
+{
+    DutyCycleBand_t *entry;
+    TimerTime_t readyTime;
+
+    if( ( DutyCycleLastBand < 0 ) || ( DutyCycleLastBand >= DUTY_CYCLE_BANDS ) )
+    {
+        return;
+    }
+    entry = &DutyCycleBands[DutyCycleLastBand];
+    // The last transmission, a retransmission of the frame or with pending
+    // MAC commands, ended before the confirmation: the off time counted from
+    // now is an upper bound of the MAC layer one
+    readyTime = now + ( TimerTime_t )timeOnAir * ( entry->DCycle - 1 );
+    if( readyTime > entry->ReadyTime )
+    {
+        entry->ReadyTime = readyTime;
+    }
+}
+
+void DutyCycleSchedulerGetBand( uint8_t band, DutyCycleBand_t *state )
+{
+    if( band < DUTY_CYCLE_BANDS )
+    {
+        *state = DutyCycleBands[band];
+    }
+}
+
+#endif // USE_BAND_868
@@ -0,0 +1,117 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Uplink scheduler keeping the ETSI duty cycle of each EU868
+             sub-band
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __DUTY_CYCLE_SCHEDULER_H__
+#define __DUTY_CYCLE_SCHEDULER_H__
+
+#include "board.h"
+
+/*!
+ * EU868 sub-bands of the MAC layer: g (865.0 - 868.0 MHz, 1 %),
+ * g1 (868.0 - 868.6 MHz, 1 %), g2 (868.7 - 869.2 MHz, 0.1 %),
+ * g3 (869.4 - 869.65 MHz, 10 %), g4 (869.7 - 870.0 MHz, 1 %)
+ */
+#define DUTY_CYCLE_BANDS                            5
+
+/*!
+ * Ledger entry of a sub-band
+ */
+typedef struct sDutyCycleBand
+{
+    uint16_t DCycle;                            // Inverse of the duty cycle, 100: 1 %
+    TimerTime_t ReadyTime;                      // Earliest legal transmission [us]
+    TimerTime_t Airtime;                        // Time on air since startup [us]
+    uint32_t Uplinks;                           // Uplinks sent in the band
+}DutyCycleBand_t;
+
+/*!
+ * \brief Initializes the ledger, all the bands free
+ */
+void DutyCycleSchedulerInit( void );
+
+/*!
+ * \brief Computes the earliest legal time to send a frame
+ *
+ * \param [IN] datarate Datarate of the frame
+ * \param [IN] now      Current time [us]
+ * \retval sendTime     Earliest time a band with a channel supporting the
+ *                      datarate is free, now if one is [us]
+ */
+TimerTime_t DutyCycleSchedulerGetSendTime( int8_t datarate, TimerTime_t now );
+
+/*!
+ * \brief Restricts the MAC layer channel mask to the free band of the
+ *        highest duty cycle, for the next uplink
+ *
+ * \param [IN] datarate Datarate of the frame
+ * \param [IN] now      Current time [us]
+ * \retval band         Selected band, -1 if none is free (mask unchanged)
+ */
+int8_t DutyCycleSchedulerSteer( int8_t datarate, TimerTime_t now );
+
+/*!
+ * \brief Gets the channels the next uplink may use without waiting
+ *
+ * \param [IN]  datarate Datarate of the frame
+ * \param [IN]  now      Current time [us]
+ * \param [OUT] budget   Duty cycle budget weight of each channel returned,
+ *                       from the duty cycle of its band [1/256]
+ * \retval channels      Mask of the enabled channels supporting the
+ *                       datarate in a free band
+ */
+uint16_t DutyCycleSchedulerGetChannels( int8_t datarate, TimerTime_t now, uint16_t *budget );
+
+/*!
+ * \brief Restricts the MAC layer channel mask to a single channel, for the
+ *        next uplink
+ *
+ * \param [IN] channel Channel, from DutyCycleSchedulerGetChannels
+ * \retval band        Band of the channel, -1 for an unknown channel
+ */
+int8_t DutyCycleSchedulerSteerChannel( int8_t channel );
+
+/*!
+ * \brief Gives the channel mask set by the network back to the MAC layer,
+ *        for the uplinks sent without the scheduler
+ */
+void DutyCycleSchedulerRelease( void );
+
+/*!
+ * \brief Records an uplink in the ledger
+ *
+ * \param [IN] band      Band selected by DutyCycleSchedulerSteer
+ * \param [IN] timeOnAir Time on air of the frame [us]
+ * \param [IN] now       Time the uplink was requested [us]
+ */
+void DutyCycleSchedulerOnTx( int8_t band, uint32_t timeOnAir, TimerTime_t now );
+
+/*!
+ * \brief Corrects the ledger with the time on air reported by the MAC layer
+ *        for the last uplink, retransmissions and MAC commands included
+ *
+ * \param [IN] timeOnAir Time on air of the last transmission [us]
+ * \param [IN] now       Time of the confirmation [us]
+ */
+void DutyCycleSchedulerOnConfirm( uint32_t timeOnAir, TimerTime_t now );
+
+/*!
+ * \brief Gets the ledger entry of a band
+ *
+ * \param [IN]  band  Band index
+ * \param [OUT] state Ledger entry
+ */
+void DutyCycleSchedulerGetBand( uint8_t band, DutyCycleBand_t *state );
+
+#endif // __DUTY_CYCLE_SCHEDULER_H__
@@ -0,0 +1,204 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Lock-free queue of the application events, from the interrupt
+             handlers and callbacks to the main loop
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "EventQueue.h"
+
+#if ( ( EVENT_QUEUE_SIZE & ( EVENT_QUEUE_SIZE - 1 ) ) != 0 )
+#error "EVENT_QUEUE_SIZE must be a power of 2"
+#endif
+
+#if ( EVENT_QUEUE_MAC_RESERVE >= EVENT_QUEUE_SIZE )
+#error "EVENT_QUEUE_MAC_RESERVE must leave slots to the other events"
+#endif
+
+/*!
+ * Queue slot. Sequence tells the slot state for the position pos it maps:
+ * pos: free for the producer reserving pos, pos + 1: event committed for the
+ * consumer, pos + EVENT_QUEUE_SIZE: released for the next lap.
+ */
+typedef struct sEventQueueSlot
+{
+    volatile uint32_t Sequence;
+    AppEvent_t Event;
+}EventQueueSlot_t;
+
+/*!
+ * Bounded multiple producer / single consumer queue. Producers reserve a
+ * position by advancing Head with a compare and swap, fill the slot and
+ * commit it through its Sequence; a producer interrupted between the two
+ * only holds back the consumer, never another producer. The consumer alone
+ * advances Tail; the producers only read it to keep the MAC reserve.
+ */
+static EventQueueSlot_t EventQueueSlots[EVENT_QUEUE_SIZE];
+static volatile uint32_t EventQueueHead = 0;
+static volatile uint32_t EventQueueTail = 0;
+
+static EventQueueStats_t EventQueueStats;
+
+/*!
+ * \brief Atomically replaces *ptr by desired if it equals expected
+ *
+ * \retval swapped true if *ptr was replaced
+ */
+static bool EventQueueCas( volatile uint32_t *ptr, uint32_t expected, uint32_t desired )
+{
+#if defined( __CORTEX_M ) && ( __CORTEX_M >= 0x03 )
+    do
+    {
+        if( __LDREXW( ptr ) != expected )
+        {
+            __CLREX( );
+            return false;
+        }
+    }while( __STREXW( desired, ptr ) != 0 );
+    return true;
+#elif defined( __CORTEX_M )
+    // ARMv6-M has no exclusive access instructions: the swap is made
+    // atomic by masking the interrupts for a few cycles
+    uint32_t primask = __get_PRIMASK( );
+    bool swapped = false;
+
+    __disable_irq( );
+    if( *ptr == expected )
+    {
+        *ptr = desired;
+        swapped = true;
+    }
+    __set_PRIMASK( primask );
+    return swapped;
+#else
+    return __sync_bool_compare_and_swap( ptr, expected, desired );
+#endif
+}
+
+/*!
+ * \brief Atomically increments a counter updated from several contexts
+ */
+static void EventQueueIncrement( volatile uint32_t *counter )
+{
+    uint32_t value;
+
+    do
+    {
+        value = *counter;
+    }while( EventQueueCas( counter, value, value + 1 ) == false );
+}
+
+/*!
+ * \brief Checks whether an event comes from the MAC layer callbacks
+ */
+static bool EventQueueIsMacEvent( AppEventType_t type )
+{
+    return ( type == APP_EVENT_MCPS_CONFIRM ) || ( type == APP_EVENT_MCPS_INDICATION ) ||
+           ( type == APP_EVENT_MLME_CONFIRM );
+}
+
+void EventQueueInit( void )
+{
+    uint32_t i;
+
+    for( i = 0; i < EVENT_QUEUE_SIZE; i++ )
+    {
+        EventQueueSlots[i].Sequence = i;
+    }
+    EventQueueHead = 0;
+    EventQueueTail = 0;
+    memset1( ( uint8_t* )&EventQueueStats, 0, sizeof( EventQueueStats ) );
+}
+
+bool EventQueuePost( AppEvent_t *event )
+{
+    EventQueueSlot_t *slot;
+    uint32_t pos = EventQueueHead;
+
+    event->PostTime = TimerGetCurrentTime( );
+    for( ;; )
+    {
+        int32_t diff;
+
+        slot = &EventQueueSlots[pos & ( EVENT_QUEUE_SIZE - 1 )];
+        diff = ( int32_t )( slot->Sequence - pos );
+        if( ( diff == 0 ) && ( EventQueueIsMacEvent( event->Type ) == false ) &&
+            ( ( pos - EventQueueTail ) >= ( EVENT_QUEUE_SIZE - EVENT_QUEUE_MAC_RESERVE ) ) )
+        {
+            // Only the reserved slots are left; a stale Tail errs on full
+            diff = -1;
+        }
+        if( diff == 0 )
+        {
+            if( EventQueueCas( &EventQueueHead, pos, pos + 1 ) == true )
+            {
+                break;
+            }
+        }
+        else if( diff < 0 )
+        {
+            // The slot still holds the event of the previous lap, or only
+            // the MAC reserve is left: full
+            EventQueueIncrement( ( volatile uint32_t* )&EventQueueStats.Overflows );
+            EventQueueIncrement( ( volatile uint32_t* )&EventQueueStats.TypeOverflows[event->Type] );
+            return false;
+        }
+        pos = EventQueueHead;
+    }
+
+    slot->Event = *event;
+    __DMB( );
+    slot->Sequence = pos + 1;
+    EventQueueIncrement( ( volatile uint32_t* )&EventQueueStats.Posted );
+    return true;
+}
+
+bool EventQueuePostType( AppEventType_t type )
+{
+    AppEvent_t event;
+
+    event.Type = type;
+    return EventQueuePost( &event );
+}
+
+bool EventQueueGet( AppEvent_t *event )
+{
+    EventQueueSlot_t *slot = &EventQueueSlots[EventQueueTail & ( EVENT_QUEUE_SIZE - 1 )];
+    TimerTime_t latency;
+
+    if( slot->Sequence != ( EventQueueTail + 1 ) )
+    {
+        return false;
+    }
+    __DMB( );
+    *event = slot->Event;
+    __DMB( );
+    slot->Sequence = EventQueueTail + EVENT_QUEUE_SIZE;
+    EventQueueTail++;
+
+    latency = TimerGetElapsedTime( event->PostTime );
+    if( latency > EventQueueStats.MaxLatency )
+    {
+        EventQueueStats.MaxLatency = ( uint32_t )latency;
+    }
+    return true;
+}
+
+bool EventQueueIsEmpty( void )
+{
+    return EventQueueSlots[EventQueueTail & ( EVENT_QUEUE_SIZE - 1 )].Sequence != ( EventQueueTail + 1 );
+}
+
+void EventQueueGetStats( EventQueueStats_t *stats )
+{
+    *stats = EventQueueStats;
+}
@@ -0,0 +1,181 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Lock-free queue of the application events, from the interrupt
+             handlers and callbacks to the main loop
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __EVENT_QUEUE_H__
+#define __EVENT_QUEUE_H__
+
+#include "board.h"
+#include "LoRaMac.h"
+
+/*!
+ * Number of events the queue holds, power of 2
+ */
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE                            8
+#endif
+
+/*!
+ * Slots only the MAC layer events may take: the other producers see the
+ * queue full earlier, so that a burst of them cannot lose an MCPS / MLME
+ * event. Covers one MCPS-Confirm, MCPS-Indication and MLME-Confirm
+ */
+#ifndef EVENT_QUEUE_MAC_RESERVE
+#define EVENT_QUEUE_MAC_RESERVE                     3
+#endif
+
+/*!
+ * Largest frame payload copied into an uplink / downlink event, longer
+ * payloads are truncated
+ */
+#define EVENT_QUEUE_DATA_MAX_SIZE                   64
+
+/*!
+ * Application event types
+ */
+typedef enum eAppEventType
+{
+    APP_EVENT_DEVICE_STATE,                     // DeviceState changed
+    APP_EVENT_SERIAL_RX,                        // Characters received on the serial console
+    APP_EVENT_NETWORK_JOINED,                   // MAC layer network join status changed
+    APP_EVENT_LED,                              // LED state changed
+    APP_EVENT_UPLINK,                           // Uplink status updated
+    APP_EVENT_DOWNLINK,                         // Downlink status updated
+    APP_EVENT_TIMER_STATS,                      // Timer statistics dump due
+    APP_EVENT_MCPS_CONFIRM,                     // MAC layer MCPS-Confirm
+    APP_EVENT_MCPS_INDICATION,                  // MAC layer MCPS-Indication
+    APP_EVENT_MLME_CONFIRM,                     // MAC layer MLME-Confirm
+    APP_EVENT_TYPES
+}AppEventType_t;
+
+/*!
+ * Uplink status, as of the MCPS-Confirm
+ */
+typedef struct sAppUplinkEvent
+{
+    bool Acked;
+    int8_t Datarate;
+    uint16_t UplinkCounter;
+    uint8_t Port;
+    uint8_t BufferSize;
+    uint8_t Buffer[EVENT_QUEUE_DATA_MAX_SIZE];
+}AppUplinkEvent_t;
+
+/*!
+ * Downlink status, as of the MCPS-Indication
+ */
+typedef struct sAppDownlinkEvent
+{
+    int16_t Rssi;
+    int8_t Snr;
+    uint16_t DownlinkCounter;
+    bool RxData;
+    uint8_t Port;
+    uint8_t BufferSize;
+    uint8_t Buffer[EVENT_QUEUE_DATA_MAX_SIZE];
+}AppDownlinkEvent_t;
+
+/*!
+ * LED state change
+ */
+typedef struct sAppLedEvent
+{
+    uint8_t Id;
+    bool State;
+}AppLedEvent_t;
+
+/*!
+ * MCPS-Indication, with a copy of the received payload: the MAC layer
+ * reuses its buffer on the next reception
+ */
+typedef struct sAppMcpsIndicationEvent
+{
+    McpsIndication_t Indication;                // Indication.Buffer is not copied
+    uint8_t Buffer[EVENT_QUEUE_DATA_MAX_SIZE];
+}AppMcpsIndicationEvent_t;
+
+/*!
+ * Application event record, a value copy of the data at the time it was
+ * posted
+ */
+typedef struct sAppEvent
+{
+    AppEventType_t Type;
+    TimerTime_t PostTime;                       // Set by EventQueuePost [us]
+    union uAppEventParam
+    {
+        AppUplinkEvent_t Uplink;
+        AppDownlinkEvent_t Downlink;
+        AppLedEvent_t Led;
+        McpsConfirm_t McpsConfirm;
+        AppMcpsIndicationEvent_t McpsIndication;
+        MlmeConfirm_t MlmeConfirm;
+    }Param;
+}AppEvent_t;
+
+/*!
+ * Queue statistics
+ */
+typedef struct sEventQueueStats
+{
+    uint32_t Posted;                            // Events queued
+    uint32_t Overflows;                         // Events lost, queue full
+    uint32_t TypeOverflows[APP_EVENT_TYPES];    // Events lost, per type
+    uint32_t MaxLatency;                        // Worst time from post to EventQueueGet [us]
+}EventQueueStats_t;
+
+/*!
+ * \brief Empties the queue and clears its statistics
+ */
+void EventQueueInit( void );
+
+/*!
+ * \brief Queues a copy of an event; may be called from any context,
+ *        including interrupt handlers preempting each other
+ *
+ * \param [IN] event Event to queue, its PostTime is set
+ * \retval queued    false if the queue is full, the event is lost; the
+ *                   MAC layer events may also take the reserved slots
+ */
+bool EventQueuePost( AppEvent_t *event );
+
+/*!
+ * \brief Queues an event without parameters
+ *
+ * \param [IN] type Event type
+ * \retval queued   false if the queue is full, the event is lost
+ */
+bool EventQueuePostType( AppEventType_t type );
+
+/*!
+ * \brief Dequeues the oldest event; main loop only (single consumer)
+ *
+ * \param [OUT] event Dequeued event
+ * \retval dequeued   false if the queue is empty
+ */
+bool EventQueueGet( AppEvent_t *event );
+
+/*!
+ * \brief Checks whether an event is ready to be dequeued
+ */
+bool EventQueueIsEmpty( void );
+
+/*!
+ * \brief Gets the queue statistics
+ *
+ * \param [OUT] stats Statistics since EventQueueInit
+ */
+void EventQueueGetStats( EventQueueStats_t *stats );
+
+#endif // __EVENT_QUEUE_H__
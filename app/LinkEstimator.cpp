@@ -0,0 +1,205 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Application side link quality estimator selecting the uplink
+             datarate
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "LinkEstimator.h"
+
+/*!
+ * Highest datarate handled, DR_5 (SF7 / 125 kHz)
+ */
+#define LINK_ESTIMATOR_DR_MAX                       5
+
+/*!
+ * EWMA weight of a downlink SNR sample, 1/2^n
+ */
+#define LINK_ESTIMATOR_DOWNLINK_SHIFT               3
+
+/*!
+ * EWMA weight of a LinkCheck sample, 1/2^n; it measures the uplink itself
+ * and weighs more than a downlink
+ */
+#define LINK_ESTIMATOR_LINK_CHECK_SHIFT             1
+
+/*!
+ * EWMA weight of an ACK outcome, 1/2^n
+ */
+#define LINK_ESTIMATOR_ACK_SHIFT                    3
+
+/*!
+ * LoRa demodulation floor of the datarates DR_0 (SF12) to DR_5 (SF7) at
+ * 125 kHz [1/16 dB]
+ */
+static const int16_t LinkEstimatorDemodFloor[LINK_ESTIMATOR_DR_MAX + 1] =
+{
+    -320, -280, -240, -200, -160, -120
+};
+
+static LinkEstimatorState_t LinkEstimator;
+
+static int8_t LinkEstimatorMinDatarate;
+static int8_t LinkEstimatorMaxDatarate;
+
+/*!
+ * Datarate of the last uplink transmitted
+ */
+static int8_t LinkEstimatorTxDatarate;
+
+/*!
+ * Uplinks transmitted, and since the last link measurement
+ */
+static uint32_t LinkEstimatorUplinks;
+static uint32_t LinkEstimatorUplinksUnmeasured;
+
+/*!
+ * Consecutive acknowledged uplinks since the last fall back step change
+ */
+static uint8_t LinkEstimatorAcks;
+
+/*!
+ * \brief Moves an EWMA towards a sample by 1/2^shift of the difference
+ */
+static int32_t LinkEstimatorEwma( int32_t average, int32_t sample, uint8_t shift )
+{
+    return average + ( sample - average ) / ( 1 << shift );
+}
+
+/*!
+ * \brief Adds a link SNR sample to the estimate
+ */
+static void LinkEstimatorAddSnr( int32_t snr, uint8_t shift )
+{
+    if( LinkEstimator.Valid == false )
+    {
+        LinkEstimator.Snr = snr;
+        LinkEstimator.Valid = true;
+    }
+    else
+    {
+        LinkEstimator.Snr = LinkEstimatorEwma( LinkEstimator.Snr, snr, shift );
+    }
+    LinkEstimatorUplinksUnmeasured = 0;
+}
+
+void LinkEstimatorInit( int8_t minDatarate, int8_t maxDatarate )
+{
+    memset1( ( uint8_t* )&LinkEstimator, 0, sizeof( LinkEstimator ) );
+    LinkEstimatorMinDatarate = minDatarate;
+    LinkEstimatorMaxDatarate = MIN( maxDatarate, LINK_ESTIMATOR_DR_MAX );
+    LinkEstimator.AckRate = 256;
+    LinkEstimator.Datarate = minDatarate;
+    LinkEstimatorTxDatarate = minDatarate;
+    LinkEstimatorUplinks = 0;
+    LinkEstimatorUplinksUnmeasured = 0;
+    LinkEstimatorAcks = 0;
+}
+
+int8_t LinkEstimatorGetDatarate( void )
+{
+    int8_t datarate = LinkEstimatorMinDatarate;
+
+    if( LinkEstimator.Valid == true )
+    {
+        // Fastest datarate keeping the margin above its demodulation floor
+        datarate = LinkEstimatorMaxDatarate;
+        while( ( datarate > LinkEstimatorMinDatarate ) &&
+               ( ( LinkEstimator.Snr - LinkEstimatorDemodFloor[datarate] ) < ( LINK_ESTIMATOR_MARGIN * 16 ) ) )
+        {
+            datarate--;
+        }
+        datarate -= LinkEstimator.Backoff;
+        if( LinkEstimator.AckRate < LINK_ESTIMATOR_MIN_ACK_RATE )
+        {
+            datarate--;
+        }
+        if( datarate < LinkEstimatorMinDatarate )
+        {
+            datarate = LinkEstimatorMinDatarate;
+        }
+    }
+    LinkEstimator.Datarate = datarate;
+    return datarate;
+}
+
+void LinkEstimatorOnTx( int8_t datarate )
+{
+    LinkEstimatorTxDatarate = datarate;
+    LinkEstimatorUplinks++;
+    if( ++LinkEstimatorUplinksUnmeasured >= LINK_ESTIMATOR_STALE_UPLINKS )
+    {
+        // Nothing heard for too long, restart from the slowest datarate
+        LinkEstimator.Valid = false;
+    }
+}
+
+void LinkEstimatorOnConfirm( bool acked )
+{
+    LinkEstimator.AckRate = LinkEstimatorEwma( LinkEstimator.AckRate, ( acked == true ) ? 256 : 0, LINK_ESTIMATOR_ACK_SHIFT );
+    if( acked == true )
+    {
+        LinkEstimator.Misses = 0;
+        if( ( LinkEstimator.Backoff > 0 ) && ( ++LinkEstimatorAcks >= LINK_ESTIMATOR_RECOVERY ) )
+        {
+            LinkEstimator.Backoff--;
+            LinkEstimatorAcks = 0;
+        }
+    }
+    else
+    {
+        LinkEstimatorAcks = 0;
+        if( ++LinkEstimator.Misses >= LINK_ESTIMATOR_MAX_MISSES )
+        {
+            LinkEstimator.Misses = 0;
+            if( LinkEstimator.Backoff < ( LinkEstimatorMaxDatarate - LinkEstimatorMinDatarate ) )
+            {
+                LinkEstimator.Backoff++;
+            }
+        }
+    }
+}
+
+void LinkEstimatorOnDownlink( int16_t rssi, int8_t snr )
+{
+    if( LinkEstimator.Valid == false )
+    {
+        LinkEstimator.Rssi = rssi * 16;
+    }
+    else
+    {
+        LinkEstimator.Rssi = LinkEstimatorEwma( LinkEstimator.Rssi, rssi * 16, LINK_ESTIMATOR_DOWNLINK_SHIFT );
+    }
+    LinkEstimatorAddSnr( snr * 16, LINK_ESTIMATOR_DOWNLINK_SHIFT );
+}
+
+void LinkEstimatorOnLinkCheck( uint8_t demodMargin, uint8_t nbGateways )
+{
+    int8_t datarate = MIN( LinkEstimatorTxDatarate, LINK_ESTIMATOR_DR_MAX );
+
+    LinkEstimator.NbGateways = nbGateways;
+    if( ( nbGateways == 0 ) || ( demodMargin == 255 ) )
+    {
+        return;
+    }
+    LinkEstimatorAddSnr( LinkEstimatorDemodFloor[datarate] + demodMargin * 16, LINK_ESTIMATOR_LINK_CHECK_SHIFT );
+}
+
+bool LinkEstimatorIsLinkCheckDue( void )
+{
+    return ( LinkEstimatorUplinks % LINK_ESTIMATOR_LINK_CHECK_PERIOD ) == 0;
+}
+
+void LinkEstimatorGetState( LinkEstimatorState_t *state )
+{
+    *state = LinkEstimator;
+}
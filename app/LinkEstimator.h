@@ -0,0 +1,137 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Application side link quality estimator selecting the uplink
+             datarate
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __LINK_ESTIMATOR_H__
+#define __LINK_ESTIMATOR_H__
+
+#include "board.h"
+
+/*!
+ * Margin kept above the demodulation floor of the selected datarate [dB]
+ */
+#ifndef LINK_ESTIMATOR_MARGIN
+#define LINK_ESTIMATOR_MARGIN                       10
+#endif
+
+/*!
+ * Consecutive unacknowledged confirmed uplinks lowering the datarate by one
+ * step
+ */
+#ifndef LINK_ESTIMATOR_MAX_MISSES
+#define LINK_ESTIMATOR_MAX_MISSES                   2
+#endif
+
+/*!
+ * Consecutive acknowledged uplinks raising back the datarate by one step
+ * after a fall back
+ */
+#ifndef LINK_ESTIMATOR_RECOVERY
+#define LINK_ESTIMATOR_RECOVERY                     4
+#endif
+
+/*!
+ * ACK success rate below which the datarate is lowered by one step [1/256]
+ */
+#ifndef LINK_ESTIMATOR_MIN_ACK_RATE
+#define LINK_ESTIMATOR_MIN_ACK_RATE                 128
+#endif
+
+/*!
+ * Uplinks between two LinkCheck requests
+ */
+#ifndef LINK_ESTIMATOR_LINK_CHECK_PERIOD
+#define LINK_ESTIMATOR_LINK_CHECK_PERIOD            16
+#endif
+
+/*!
+ * Uplinks without any link measurement after which the estimate is dropped
+ */
+#ifndef LINK_ESTIMATOR_STALE_UPLINKS
+#define LINK_ESTIMATOR_STALE_UPLINKS                32
+#endif
+
+/*!
+ * Link estimator state, SNR and RSSI in 1/16 dB
+ */
+typedef struct sLinkEstimatorState
+{
+    bool Valid;                                 // A link measurement is available
+    int32_t Snr;                                // EWMA of the link SNR
+    int32_t Rssi;                               // EWMA of the downlink RSSI
+    uint8_t NbGateways;                         // Gateways of the last LinkCheck
+    uint16_t AckRate;                           // EWMA of the ACK success [1/256]
+    uint8_t Misses;                             // Consecutive unacknowledged uplinks
+    uint8_t Backoff;                            // Datarate steps removed by the misses
+    int8_t Datarate;                            // Selected datarate
+}LinkEstimatorState_t;
+
+/*!
+ * \brief Initializes the estimator, with no link measurement
+ *
+ * \param [IN] minDatarate Slowest datarate, used without measurement
+ * \param [IN] maxDatarate Fastest datarate allowed, up to DR_5
+ */
+void LinkEstimatorInit( int8_t minDatarate, int8_t maxDatarate );
+
+/*!
+ * \brief Gets the datarate of the next uplink
+ *
+ * \retval datarate Fastest datarate meeting the margin, after the fall backs
+ */
+int8_t LinkEstimatorGetDatarate( void );
+
+/*!
+ * \brief Records an uplink transmission
+ *
+ * \param [IN] datarate Datarate of the uplink
+ */
+void LinkEstimatorOnTx( int8_t datarate );
+
+/*!
+ * \brief Records the outcome of a confirmed uplink
+ *
+ * \param [IN] acked true if the uplink was acknowledged
+ */
+void LinkEstimatorOnConfirm( bool acked );
+
+/*!
+ * \brief Records the radio conditions of a downlink
+ *
+ * \param [IN] rssi Downlink RSSI [dBm]
+ * \param [IN] snr  Downlink SNR [dB]
+ */
+void LinkEstimatorOnDownlink( int16_t rssi, int8_t snr );
+
+/*!
+ * \brief Records a LinkCheck answer, for the last uplink transmitted
+ *
+ * \param [IN] demodMargin Uplink SNR above the demodulation floor [dB]
+ * \param [IN] nbGateways  Number of gateways that received the uplink
+ */
+void LinkEstimatorOnLinkCheck( uint8_t demodMargin, uint8_t nbGateways );
+
+/*!
+ * \brief Checks whether a LinkCheck request should go with the next uplink
+ */
+bool LinkEstimatorIsLinkCheckDue( void );
+
+/*!
+ * \brief Gets the estimator state
+ *
+ * \param [OUT] state Estimator state
+ */
+void LinkEstimatorGetState( LinkEstimatorState_t *state );
+
+#endif // __LINK_ESTIMATOR_H__
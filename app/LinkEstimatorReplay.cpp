@@ -0,0 +1,236 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host replay of a recorded link trace through the link
+             estimator: projected airtime and battery life against the
+             fixed DR_0 uplinks
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+
+Built for the host only, with LINK_ESTIMATOR_REPLAY defined. The replay
+never arms a timer: host/ supplies board.h for the types and the EU868
+datarates, and no ticker is linked in:
+
+    g++ -O2 -DLINK_ESTIMATOR_REPLAY -DUSE_BAND_868 -Ihost -I. -Isystem -Iapp \
+        app/LinkEstimatorReplay.cpp app/LinkEstimator.cpp app/TimeOnAir.cpp \
+        system/utilities.cpp -o link_replay
+
+    ./link_replay [options] trace
+
+The trace has one line per uplink, '#' starting a comment:
+
+    <uplink SNR at the gateway [dB]> <downlink RSSI [dBm]> <downlink SNR [dB]>
+
+as logged by the network server metadata and the device. An uplink at a
+datarate is delivered when its SNR reaches the demodulation floor of the
+datarate; its ACK, in RX1 at the same datarate, when the downlink SNR does.
+There is one transmission per line, the MAC layer retransmissions are not
+modelled, for the estimator as for the DR_0 reference. Options:
+
+    --size N           application payload [bytes], default 6
+    --period S         uplink period [s], default 60
+    --unconfirmed      unconfirmed uplinks, no ACK feedback
+    --tx-current MA    radio current while transmitting [mA], default 44
+    --sleep-current UA device current between uplinks [uA], default 5
+    --capacity MAH     battery capacity [mAh], default 2400
+*/
+#if defined( LINK_ESTIMATOR_REPLAY )
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "LinkEstimator.h"
+#include "TimeOnAir.h"
+
+/*!
+ * Size of the LinkCheckReq MAC command [bytes]
+ */
+#define REPLAY_LINK_CHECK_SIZE                      1
+
+/*!
+ * Datarates DR_0 to DR_5
+ */
+#define REPLAY_DATARATES                            6
+
+typedef struct
+{
+    const char *Name;
+    uint32_t Uplinks;
+    uint32_t Delivered;
+    uint32_t Acked;
+    uint32_t PerDatarate[REPLAY_DATARATES];
+    uint64_t Airtime;                           // [us]
+}ReplayResult_t;
+
+/*!
+ * \brief LoRa demodulation floor of a datarate at 125 kHz [dB]
+ */
+static double DemodFloor( int8_t datarate )
+{
+    return -20.0 + 2.5 * datarate;
+}
+
+static void Report( const ReplayResult_t *r, uint32_t period, double txCurrent, double sleepCurrent, double capacity )
+{
+    double airtime = r->Airtime / 1e6;
+    double elapsed = ( double )r->Uplinks * period;
+    // Average current [mA]: transmissions plus sleep for the rest of the time
+    double current = ( airtime * txCurrent + ( elapsed - airtime ) * sleepCurrent / 1000.0 ) / elapsed;
+    uint8_t dr;
+
+    printf( "%-10s uplinks %6u  delivered %6u (%5.1f %%)  acked %6u\n", r->Name, r->Uplinks, r->Delivered,
+            100.0 * r->Delivered / r->Uplinks, r->Acked );
+    printf( "%-10s airtime %10.1f s  %8.1f ms/uplink  duty cycle %6.3f %%\n", "", airtime,
+            1000.0 * airtime / r->Uplinks, 100.0 * airtime / elapsed );
+    printf( "%-10s TX charge %8.2f mAh  average current %8.2f uA  battery %8.0f days\n", "",
+            airtime * txCurrent / 3600.0, current * 1000.0, capacity / current / 24.0 );
+    printf( "%-10s uplinks per datarate:", "" );
+    for( dr = 0; dr < REPLAY_DATARATES; dr++ )
+    {
+        printf( " DR%u %u", dr, r->PerDatarate[dr] );
+    }
+    printf( "\n" );
+}
+
+static void Usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [--size N] [--period S] [--unconfirmed] [--tx-current MA] "
+                     "[--sleep-current UA] [--capacity MAH] trace\n", name );
+}
+
+int main( int argc, char **argv )
+{
+    ReplayResult_t estimator;
+    ReplayResult_t reference;
+    uint32_t size = 6;
+    uint32_t period = 60;
+    bool confirmed = true;
+    double txCurrent = 44.0;
+    double sleepCurrent = 5.0;
+    double capacity = 2400.0;
+    const char *path = NULL;
+    char line[128];
+    FILE *trace;
+    int a;
+
+    memset( &estimator, 0, sizeof( ReplayResult_t ) );
+    memset( &reference, 0, sizeof( ReplayResult_t ) );
+    estimator.Name = "estimator";
+    reference.Name = "DR_0";
+
+    for( a = 1; a < argc; a++ )
+    {
+        if( ( strcmp( argv[a], "--size" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            size = strtoul( argv[++a], NULL, 0 );
+        }
+        else if( ( strcmp( argv[a], "--period" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            period = strtoul( argv[++a], NULL, 0 );
+        }
+        else if( strcmp( argv[a], "--unconfirmed" ) == 0 )
+        {
+            confirmed = false;
+        }
+        else if( ( strcmp( argv[a], "--tx-current" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            txCurrent = atof( argv[++a] );
+        }
+        else if( ( strcmp( argv[a], "--sleep-current" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            sleepCurrent = atof( argv[++a] );
+        }
+        else if( ( strcmp( argv[a], "--capacity" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            capacity = atof( argv[++a] );
+        }
+        else if( ( argv[a][0] != '-' ) && ( path == NULL ) )
+        {
+            path = argv[a];
+        }
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+    if( ( path == NULL ) || ( period == 0 ) || ( size > 64 ) )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+    trace = fopen( path, "r" );
+    if( trace == NULL )
+    {
+        perror( path );
+        return EXIT_FAILURE;
+    }
+
+    LinkEstimatorInit( 0, REPLAY_DATARATES - 1 );
+    while( fgets( line, sizeof( line ), trace ) != NULL )
+    {
+        double upSnr, downSnr, rssi;
+        bool linkCheck, delivered, acked;
+        int8_t dr;
+
+        if( ( line[0] == '#' ) || ( sscanf( line, "%lf %lf %lf", &upSnr, &rssi, &downSnr ) != 3 ) )
+        {
+            continue;
+        }
+
+        // Estimator driven uplink
+        dr = LinkEstimatorGetDatarate( );
+        linkCheck = LinkEstimatorIsLinkCheckDue( );
+        LinkEstimatorOnTx( dr );
+        delivered = upSnr >= DemodFloor( dr );
+        acked = delivered && ( downSnr >= DemodFloor( dr ) );
+        if( acked == true )
+        {
+            // The ACK, or the LinkCheckAns, is a downlink
+            LinkEstimatorOnDownlink( ( int16_t )rssi, ( int8_t )downSnr );
+            if( linkCheck == true )
+            {
+                LinkEstimatorOnLinkCheck( ( uint8_t )( upSnr - DemodFloor( dr ) ), 1 );
+            }
+        }
+        if( confirmed == true )
+        {
+            LinkEstimatorOnConfirm( acked );
+        }
+        estimator.Uplinks++;
+        estimator.Delivered += delivered;
+        estimator.Acked += acked && confirmed;
+        estimator.PerDatarate[dr]++;
+        estimator.Airtime += TimeOnAirGet( dr, TIME_ON_AIR_FRAME_OVERHEAD + size + ( linkCheck ? REPLAY_LINK_CHECK_SIZE : 0 ) );
+
+        // Reference, every uplink at DR_0
+        delivered = upSnr >= DemodFloor( 0 );
+        reference.Uplinks++;
+        reference.Delivered += delivered;
+        reference.Acked += delivered && confirmed && ( downSnr >= DemodFloor( 0 ) );
+        reference.PerDatarate[0]++;
+        reference.Airtime += TimeOnAirGet( 0, TIME_ON_AIR_FRAME_OVERHEAD + size );
+    }
+    fclose( trace );
+
+    if( estimator.Uplinks == 0 )
+    {
+        fprintf( stderr, "%s: no uplink\n", path );
+        return EXIT_FAILURE;
+    }
+    Report( &reference, period, txCurrent, sleepCurrent, capacity );
+    Report( &estimator, period, txCurrent, sleepCurrent, capacity );
+    printf( "airtime saved %5.1f %%\n", 100.0 * ( 1.0 - ( double )estimator.Airtime / reference.Airtime ) );
+    return EXIT_SUCCESS;
+}
+
+#endif // LINK_ESTIMATOR_REPLAY
@@ -0,0 +1,160 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Aggregation of the application samples, several per uplink
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "SampleAggregator.h"
+
+#if( ( SAMPLE_AGGREGATOR_RING_SIZE & ( SAMPLE_AGGREGATOR_RING_SIZE - 1 ) ) != 0 )
+#error "SAMPLE_AGGREGATOR_RING_SIZE must be a power of 2"
+#endif
+
+typedef struct sSampleAggregatorSample
+{
+    TimerTime_t Time;
+    uint8_t Data[SAMPLE_AGGREGATOR_SAMPLE_SIZE];
+}SampleAggregatorSample_t;
+
+static SampleAggregatorSample_t SampleAggregatorRing[SAMPLE_AGGREGATOR_RING_SIZE];
+
+/*!
+ * Ring indexes, free running
+ */
+static uint32_t SampleAggregatorHead;
+static uint32_t SampleAggregatorTail;
+
+/*!
+ * An urgent sample waits in the ring
+ */
+static bool SampleAggregatorUrgent;
+
+/*!
+ * Samples of the last packed payload, and of the last uplink sent waiting
+ * for its outcome
+ */
+static uint8_t SampleAggregatorPacked;
+static uint8_t SampleAggregatorInFlight;
+
+static SampleAggregatorStats_t SampleAggregatorStats;
+
+static uint32_t SampleAggregatorCount( void )
+{
+    return SampleAggregatorHead - SampleAggregatorTail;
+}
+
+void SampleAggregatorInit( void )
+{
+    SampleAggregatorHead = 0;
+    SampleAggregatorTail = 0;
+    SampleAggregatorUrgent = false;
+    SampleAggregatorPacked = 0;
+    SampleAggregatorInFlight = 0;
+    memset1( ( uint8_t* )&SampleAggregatorStats, 0, sizeof( SampleAggregatorStats ) );
+}
+
+void SampleAggregatorAdd( const uint8_t *data, bool urgent, TimerTime_t now )
+{
+    SampleAggregatorSample_t *sample;
+
+    if( SampleAggregatorCount( ) == SAMPLE_AGGREGATOR_RING_SIZE )
+    {
+        SampleAggregatorTail++;
+        SampleAggregatorStats.Dropped++;
+        // The packed payload no longer matches the ring
+        SampleAggregatorPacked = 0;
+    }
+    sample = &SampleAggregatorRing[SampleAggregatorHead & ( SAMPLE_AGGREGATOR_RING_SIZE - 1 )];
+    sample->Time = now;
+    memcpy1( sample->Data, data, SAMPLE_AGGREGATOR_SAMPLE_SIZE );
+    SampleAggregatorHead++;
+    SampleAggregatorUrgent |= urgent;
+    SampleAggregatorStats.Samples++;
+}
+
+bool SampleAggregatorIsFlushDue( uint8_t maxSize, TimerTime_t now )
+{
+    uint32_t count = SampleAggregatorCount( );
+
+    if( count == 0 )
+    {
+        return false;
+    }
+    if( SampleAggregatorUrgent == true )
+    {
+        return true;
+    }
+    if( ( now - SampleAggregatorRing[SampleAggregatorTail & ( SAMPLE_AGGREGATOR_RING_SIZE - 1 )].Time ) >= SAMPLE_AGGREGATOR_MAX_AGE )
+    {
+        return true;
+    }
+    // Full when one more sample would not fit, or the ring would drop one
+    return ( ( SAMPLE_AGGREGATOR_HEADER_SIZE + ( count + 1 ) * SAMPLE_AGGREGATOR_RECORD_SIZE ) > maxSize ) ||
+           ( count == SAMPLE_AGGREGATOR_RING_SIZE );
+}
+
+uint8_t SampleAggregatorPack( uint8_t *buffer, uint8_t maxSize, TimerTime_t now )
+{
+    SampleAggregatorSample_t *sample;
+    uint32_t count = SampleAggregatorCount( );
+    uint8_t size = SAMPLE_AGGREGATOR_HEADER_SIZE;
+    uint32_t age;
+    uint8_t n = 0;
+
+    if( maxSize < SAMPLE_AGGREGATOR_HEADER_SIZE )
+    {
+        SampleAggregatorPacked = 0;
+        return 0;
+    }
+    while( ( n < count ) && ( ( size + SAMPLE_AGGREGATOR_RECORD_SIZE ) <= maxSize ) )
+    {
+        sample = &SampleAggregatorRing[( SampleAggregatorTail + n ) & ( SAMPLE_AGGREGATOR_RING_SIZE - 1 )];
+        age = ( uint32_t )MIN( ( now - sample->Time ) / 1000000, 0xFFFF );
+        buffer[size++] = age >> 8;
+        buffer[size++] = age;
+        memcpy1( buffer + size, sample->Data, SAMPLE_AGGREGATOR_SAMPLE_SIZE );
+        size += SAMPLE_AGGREGATOR_SAMPLE_SIZE;
+        n++;
+    }
+    buffer[0] = n;
+    SampleAggregatorPacked = n;
+    return size;
+}
+
+void SampleAggregatorOnSent( uint32_t timeOnAir, uint32_t singleTimeOnAir )
+{
+    SampleAggregatorTail += SampleAggregatorPacked;
+    if( SampleAggregatorCount( ) == 0 )
+    {
+        SampleAggregatorUrgent = false;
+    }
+    SampleAggregatorInFlight = SampleAggregatorPacked;
+    SampleAggregatorStats.Sent += SampleAggregatorPacked;
+    SampleAggregatorStats.Uplinks++;
+    SampleAggregatorStats.Airtime += timeOnAir;
+    SampleAggregatorStats.SingleAirtime += ( TimerTime_t )singleTimeOnAir * SampleAggregatorPacked;
+    SampleAggregatorPacked = 0;
+}
+
+void SampleAggregatorOnConfirm( bool delivered )
+{
+    if( delivered == true )
+    {
+        SampleAggregatorStats.Delivered += SampleAggregatorInFlight;
+    }
+    SampleAggregatorInFlight = 0;
+}
+
+void SampleAggregatorGetStats( SampleAggregatorStats_t *stats )
+{
+    *stats = SampleAggregatorStats;
+}
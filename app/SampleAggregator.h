@@ -0,0 +1,123 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Aggregation of the application samples, several per uplink
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __SAMPLE_AGGREGATOR_H__
+#define __SAMPLE_AGGREGATOR_H__
+
+#include "board.h"
+
+/*!
+ * Samples kept waiting for an uplink, power of 2. The oldest sample is
+ * dropped when a sample is added to a full ring.
+ */
+#ifndef SAMPLE_AGGREGATOR_RING_SIZE
+#define SAMPLE_AGGREGATOR_RING_SIZE                 16
+#endif
+
+/*!
+ * Sample size [bytes]
+ */
+#ifndef SAMPLE_AGGREGATOR_SAMPLE_SIZE
+#define SAMPLE_AGGREGATOR_SAMPLE_SIZE               6
+#endif
+
+/*!
+ * Largest age of the oldest sample before the samples are flushed [us]
+ */
+#ifndef SAMPLE_AGGREGATOR_MAX_AGE
+#define SAMPLE_AGGREGATOR_MAX_AGE                   60000000
+#endif
+
+/*!
+ * Packed frame: sample count byte, then per sample, oldest first, its age
+ * at packing [s] on 2 bytes (MSB first, saturated) and its data
+ */
+#define SAMPLE_AGGREGATOR_HEADER_SIZE               1
+#define SAMPLE_AGGREGATOR_RECORD_SIZE               ( 2 + SAMPLE_AGGREGATOR_SAMPLE_SIZE )
+
+/*!
+ * Aggregation counters
+ */
+typedef struct sSampleAggregatorStats
+{
+    uint32_t Samples;                           // Samples added
+    uint32_t Dropped;                           // Samples dropped, ring full
+    uint32_t Sent;                              // Samples sent
+    uint32_t Delivered;                         // Samples sent and delivered
+    uint32_t Uplinks;                           // Uplinks carrying samples
+    TimerTime_t Airtime;                        // Time on air of these uplinks [us]
+    TimerTime_t SingleAirtime;                  // Time on air of the samples sent one per uplink [us]
+}SampleAggregatorStats_t;
+
+/*!
+ * \brief Initializes the aggregation, ring empty and counters cleared
+ */
+void SampleAggregatorInit( void );
+
+/*!
+ * \brief Adds a sample to the ring
+ *
+ * \param [IN] data   Sample, SAMPLE_AGGREGATOR_SAMPLE_SIZE bytes
+ * \param [IN] urgent The samples are flushed at the next uplink opportunity
+ * \param [IN] now    Time of the sample [us]
+ */
+void SampleAggregatorAdd( const uint8_t *data, bool urgent, TimerTime_t now );
+
+/*!
+ * \brief Checks if the samples have to be sent: an urgent sample, the
+ *        oldest sample reaching SAMPLE_AGGREGATOR_MAX_AGE, or no room left
+ *        in the frame for one more sample
+ *
+ * \param [IN] maxSize Largest payload of the next uplink [bytes]
+ * \param [IN] now     Current time [us]
+ * \retval flush       true when an uplink is due
+ */
+bool SampleAggregatorIsFlushDue( uint8_t maxSize, TimerTime_t now );
+
+/*!
+ * \brief Packs the oldest samples fitting in a payload. They stay in the
+ *        ring until SampleAggregatorOnSent.
+ *
+ * \param [OUT] buffer  Payload
+ * \param [IN]  maxSize Largest payload of the uplink [bytes]
+ * \param [IN]  now     Current time [us]
+ * \retval size         Payload size [bytes]
+ */
+uint8_t SampleAggregatorPack( uint8_t *buffer, uint8_t maxSize, TimerTime_t now );
+
+/*!
+ * \brief Removes the samples of the last packed payload, accepted by the MAC
+ *        layer, from the ring
+ *
+ * \param [IN] timeOnAir       Time on air of the uplink [us]
+ * \param [IN] singleTimeOnAir Time on air of an uplink of a single sample, at
+ *                             the same datarate [us]
+ */
+void SampleAggregatorOnSent( uint32_t timeOnAir, uint32_t singleTimeOnAir );
+
+/*!
+ * \brief Records the outcome of the last uplink carrying samples
+ *
+ * \param [IN] delivered The uplink was acknowledged, or sent unconfirmed
+ */
+void SampleAggregatorOnConfirm( bool delivered );
+
+/*!
+ * \brief Gets the aggregation counters
+ *
+ * \param [OUT] stats Counters
+ */
+void SampleAggregatorGetStats( SampleAggregatorStats_t *stats );
+
+#endif // __SAMPLE_AGGREGATOR_H__
@@ -14,10 +14,45 @@ Maintainer: Miguel Luis and Gregory Cristian
 */
 #include "board.h"
 #include "vt100.h"
+#include "LinkEstimator.h"
+#include "SampleAggregator.h"
 #include "SerialDisplay.h"
 
 VT100 vt( USBTX, USBRX );
 
+/*!
+ * Received characters, filled by the serial RX interrupt
+ */
+#define SERIAL_DISPLAY_RX_SIZE                      16
+
+static volatile uint8_t RxBuffer[SERIAL_DISPLAY_RX_SIZE];
+static volatile uint8_t RxHead = 0;
+static volatile uint8_t RxTail = 0;
+static void ( *RxHandler )( void ) = NULL;
+
+/*!
+ * \brief Serial RX interrupt, queues the received characters
+ */
+static void SerialDisplayOnRx( void )
+{
+    while( vt.Readable( ) == true )
+    {
+        uint8_t c = vt.GetChar( );
+        uint8_t next = ( RxHead + 1 ) % SERIAL_DISPLAY_RX_SIZE;
+
+        // Drops the character when full
+        if( next != RxTail )
+        {
+            RxBuffer[RxHead] = c;
+            RxHead = next;
+        }
+    }
+    if( RxHandler != NULL )
+    {
+        RxHandler( );
+    }
+}
+
 void SerialPrintCheckBox( bool activated, uint8_t color )
 {
     if( activated == true )
@@ -249,6 +284,119 @@ void SerialDisplayUpdateDownlink( bool rxData, int16_t rssi, int8_t snr, uint16_
     }
 }
 
+void SerialDisplayUpdateIdle( uint32_t idle, uint32_t current )
+{
+    vt.SetCursorPos( 43, 1 );
+    vt.printf( "CPU idle %3u.%u %%  MCU current (est.) %5u uA", idle / 10, idle % 10, current );
+}
+
+void SerialDisplayUpdateEventQueue( uint32_t posted, uint32_t overflows, uint32_t maxLatency )
+{
+    vt.SetCursorPos( 44, 1 );
+    vt.printf( "Events %10u  lost %8u  latency max %8u us", posted, overflows, maxLatency );
+}
+
+void SerialDisplayUpdateMacCallbacks( bool deferred, uint32_t mcpsConfirm, uint32_t mcpsIndication, uint32_t mlmeConfirm )
+{
+    vt.SetCursorPos( 45, 1 );
+    vt.printf( "MAC callbacks (%s) max: MCPS confirm %6u us  indication %6u us  MLME confirm %6u us",
+               deferred ? "deferred" : "inline", mcpsConfirm, mcpsIndication, mlmeConfirm );
+}
+
+void SerialDisplayUpdateLinkEstimator( const LinkEstimatorState_t *state )
+{
+    // SNR in 1/16 dB, shown with one decimal
+    uint32_t snr = ( state->Snr < 0 ) ? -state->Snr : state->Snr;
+
+    vt.SetCursorPos( 46, 1 );
+    if( state->Valid == false )
+    {
+        vt.printf( "Link DR%u  no measurement                                                      ", state->Datarate );
+        return;
+    }
+    vt.printf( "Link DR%u  SNR %c%2u.%u dB  RSSI %4d dBm  gateways %3u  ACK %3u %%  fall back %u  ",
+               state->Datarate, ( state->Snr < 0 ) ? '-' : ' ', snr / 16, ( ( snr % 16 ) * 10 ) / 16,
+               state->Rssi / 16, state->NbGateways, ( state->AckRate * 100 ) / 256, state->Backoff );
+}
+
+void SerialDisplayUpdateTimeOnAir( uint32_t last, TimerTime_t total, uint32_t uplinks, uint32_t duty )
+{
+    uint32_t totalMs = ( uint32_t )( total / 1000 );
+
+    vt.SetCursorPos( 47, 1 );
+    vt.printf( "Time on air last %5u.%03u ms  total %7u.%03u s  uplinks %6u  duty %2u.%03u %%",
+               last / 1000, last % 1000, totalMs / 1000, totalMs % 1000, uplinks, duty / 1000, duty % 1000 );
+}
+
+void SerialDisplayUpdateDutyCycleScheduler( const uint32_t *readyIn, uint8_t nbBands, uint32_t deferrals )
+{
+    uint8_t i;
+
+    vt.SetCursorPos( 48, 1 );
+    vt.printf( "Sub-bands ready in" );
+    for( i = 0; i < nbBands; i++ )
+    {
+        vt.printf( "  g%u %5u.%01u s", i, readyIn[i] / 1000, ( readyIn[i] % 1000 ) / 100 );
+    }
+    vt.printf( "  deferred %6u", deferrals );
+}
+
+void SerialDisplayUpdateChannelQuality( const char *policy, const uint8_t *score, uint8_t nbChannels )
+{
+    uint8_t i;
+
+    vt.SetCursorPos( 49, 1 );
+    vt.printf( "Channels %-8s [%%]", policy );
+    for( i = 0; i < nbChannels; i++ )
+    {
+        if( score[i] != 0xFF )
+        {
+            vt.printf( " %u:%3u", i, score[i] );
+        }
+    }
+}
+
+void SerialDisplayUpdateAggregation( const SampleAggregatorStats_t *stats )
+{
+    // Airtime per delivered sample, aggregated and one sample per uplink [us]
+    uint32_t airtime = ( stats->Delivered != 0 ) ? ( uint32_t )( stats->Airtime / stats->Delivered ) : 0;
+    uint32_t single = ( stats->Sent != 0 ) ? ( uint32_t )( stats->SingleAirtime / stats->Sent ) : 0;
+    uint32_t saved = ( stats->Sent != 0 ) ? 100 - ( stats->Uplinks * 100 ) / stats->Sent : 0;
+
+    vt.SetCursorPos( 50, 1 );
+    vt.printf( "Samples %6u in %5u uplinks (-%2u %%)  airtime/sample %4u.%03u ms (single %4u.%03u ms)  dropped %4u",
+               stats->Sent, stats->Uplinks, saved, airtime / 1000, airtime % 1000, single / 1000, single % 1000,
+               stats->Dropped );
+}
+
+#if defined( TIMER_STATS )
+void SerialDisplayUpdateTimerDispatch( uint8_t line, uint32_t wakeups, uint32_t intermediate, uint32_t maxIsrDuration, uint32_t overlaps )
+{
+    vt.SetCursorPos( line, 1 );
+    vt.printf( "Timer wake ups %10u (no expiry %10u)  ISR max %8u us  overlaps %8u", wakeups, intermediate, maxIsrDuration, overlaps );
+}
+
+void SerialDisplayUpdateTimerStats( uint8_t line, const char *name, void ( *callback )( void ), const TimerStats_t *stats )
+{
+    uint8_t i;
+
+    vt.SetCursorPos( line, 1 );
+    if( name != NULL )
+    {
+        vt.printf( "%-12s", name );
+    }
+    else
+    {
+        vt.printf( "0x%08X  ", ( uint32_t )callback );
+    }
+    vt.printf( " %8u late max %8u us ovl %6u |", stats->Count, stats->MaxLateness, stats->Overlaps );
+    for( i = 0; i < TIMER_STATS_BINS; i++ )
+    {
+        vt.printf( " %u", stats->Histogram[i] );
+    }
+}
+#endif
+
 void SerialDisplayDrawFirstLine( void )
 {
     vt.PutBoxDrawingChar( 'l' );
@@ -433,12 +581,21 @@ void SerialDisplayInit( void )
     vt.printf( "To refresh screen please hit 'r' key.\r\n" );
 }
 
+void SerialDisplaySetRxHandler( void ( *handler )( void ) )
+{
+    RxHandler = handler;
+    vt.attach( &SerialDisplayOnRx, SerialBase::RxIrq );
+}
+
 bool SerialDisplayReadable( void )
 {
-    return vt.Readable( );
+    return RxHead != RxTail;
 }
 
 uint8_t SerialDisplayGetChar( void )
 {
-    return vt.GetChar( );
+    uint8_t c = RxBuffer[RxTail];
+
+    RxTail = ( RxTail + 1 ) % SERIAL_DISPLAY_RX_SIZE;
+    return c;
 }
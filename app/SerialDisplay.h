@@ -33,7 +33,20 @@ void SerialDisplayUpdateData( uint8_t *buffer );
 void SerialDisplayUpdateNetworkIsJoined( bool state );
 void SerialDisplayUpdateUplinkAcked( bool state );
 void SerialDisplayUpdateDonwlinkRxData( bool state );
+void SerialDisplayUpdateIdle( uint32_t idle, uint32_t current );
+void SerialDisplayUpdateEventQueue( uint32_t posted, uint32_t overflows, uint32_t maxLatency );
+void SerialDisplayUpdateMacCallbacks( bool deferred, uint32_t mcpsConfirm, uint32_t mcpsIndication, uint32_t mlmeConfirm );
+void SerialDisplayUpdateLinkEstimator( const LinkEstimatorState_t *state );
+void SerialDisplayUpdateTimeOnAir( uint32_t last, TimerTime_t total, uint32_t uplinks, uint32_t duty );
+void SerialDisplayUpdateDutyCycleScheduler( const uint32_t *readyIn, uint8_t nbBands, uint32_t deferrals );
+void SerialDisplayUpdateChannelQuality( const char *policy, const uint8_t *score, uint8_t nbChannels );
+void SerialDisplayUpdateAggregation( const SampleAggregatorStats_t *stats );
+void SerialDisplaySetRxHandler( void ( *handler )( void ) );
 bool SerialDisplayReadable( void );
 uint8_t SerialDisplayGetChar( void );
+#if defined( TIMER_STATS )
+void SerialDisplayUpdateTimerDispatch( uint8_t line, uint32_t wakeups, uint32_t intermediate, uint32_t maxIsrDuration, uint32_t overlaps );
+void SerialDisplayUpdateTimerStats( uint8_t line, const char *name, void ( *callback )( void ), const TimerStats_t *stats );
+#endif
 
 #endif // __SERIAL_DISPLAY_H__
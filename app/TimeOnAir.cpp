@@ -0,0 +1,164 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Time on air of the LoRaWAN frames, from tables computed at
+             compile time per datarate and payload length
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include "board.h"
+#include "TimeOnAir.h"
+
+/*
+ * SX1276 LoRa time on air (datasheet 4.1.1.7):
+ *
+ *   Tsym     = 2^SF / BW
+ *   Tpreamble = ( Npreamble + 4.25 ) * Tsym
+ *   Npayload = 8 + max( ceil( ( 8 PL - 4 SF + 28 + 16 CRC - 20 IH ) /
+ *                             ( 4 ( SF - 2 DE ) ) ) * ( CR + 4 ), 0 )
+ *   ToA      = Tpreamble + Npayload * Tsym
+ *
+ * Tsym is a whole number of microseconds at 125, 250 and 500 kHz, which
+ * keeps the computation exact in integers.
+ */
+
+/*!
+ * \brief LoRa symbol time [us]
+ */
+static constexpr uint32_t TimeOnAirSymbol( uint8_t sf, uint16_t bandwidth )
+{
+    return ( ( uint32_t )1000 << sf ) / bandwidth;
+}
+
+/*!
+ * \brief Low datarate optimization, mandated above 16 ms symbols
+ */
+static constexpr bool TimeOnAirLowDatarateOpt( uint8_t sf, uint16_t bandwidth )
+{
+    return TimeOnAirSymbol( sf, bandwidth ) > 16000;
+}
+
+static constexpr int32_t TimeOnAirPayloadBits( uint8_t sf, bool implicitHeader, bool crcOn, uint8_t size )
+{
+    return 8 * size - 4 * sf + 28 + ( crcOn ? 16 : 0 ) - ( implicitHeader ? 20 : 0 );
+}
+
+static constexpr uint32_t TimeOnAirCeil( int32_t num, int32_t den )
+{
+    return ( num > 0 ) ? ( uint32_t )( ( num + den - 1 ) / den ) : 0;
+}
+
+static constexpr uint32_t TimeOnAirPayloadSymbols( uint8_t sf, uint8_t codingRate, bool implicitHeader,
+                                                   bool crcOn, bool lowDatarateOpt, uint8_t size )
+{
+    return 8 + TimeOnAirCeil( TimeOnAirPayloadBits( sf, implicitHeader, crcOn, size ),
+                              4 * ( sf - ( lowDatarateOpt ? 2 : 0 ) ) ) * ( codingRate + 4 );
+}
+
+static constexpr uint32_t TimeOnAirCompute( uint8_t sf, uint16_t bandwidth, uint8_t codingRate, uint16_t preamble,
+                                            bool implicitHeader, bool crcOn, bool lowDatarateOpt, uint8_t size )
+{
+    return ( ( 4 * preamble + 17 ) * TimeOnAirSymbol( sf, bandwidth ) ) / 4 +
+           TimeOnAirPayloadSymbols( sf, codingRate, implicitHeader, crcOn, lowDatarateOpt, size ) * TimeOnAirSymbol( sf, bandwidth );
+}
+
+/*!
+ * \brief Time on air of a LoRaWAN FSK frame at 50 kbps: 5 bytes preamble,
+ *        3 bytes sync word, length byte, payload and CRC [us]
+ */
+static constexpr uint32_t TimeOnAirFsk( uint8_t size )
+{
+    return ( 5 + 3 + 1 + size + 2 ) * 8 * 1000 / 50;
+}
+
+#if defined( USE_BAND_433 ) || defined( USE_BAND_780 ) || defined( USE_BAND_868 )
+
+/*!
+ * Datarates DR_0 to DR_7: SF12 to SF7 at 125 kHz, SF7 at 250 kHz, FSK
+ * 50 kbps (spreading factor 0)
+ */
+#define TIME_ON_AIR_DATARATES                       8
+
+static constexpr uint8_t TimeOnAirSf[TIME_ON_AIR_DATARATES] = { 12, 11, 10, 9, 8, 7, 7, 0 };
+static constexpr uint16_t TimeOnAirBandwidth[TIME_ON_AIR_DATARATES] = { 125, 125, 125, 125, 125, 125, 250, 0 };
+
+/*!
+ * \brief Time on air of an uplink frame at a datarate of the plan
+ */
+static constexpr uint32_t TimeOnAirUplink( uint8_t datarate, uint8_t size )
+{
+    return ( TimeOnAirSf[datarate] == 0 ) ? TimeOnAirFsk( size ) :
+           TimeOnAirCompute( TimeOnAirSf[datarate], TimeOnAirBandwidth[datarate], 1, 8, false, true,
+                             TimeOnAirLowDatarateOpt( TimeOnAirSf[datarate], TimeOnAirBandwidth[datarate] ), size );
+}
+
+#define toa_4( dr, n )      TimeOnAirUplink( dr, n ), TimeOnAirUplink( dr, n + 1 ),\
+                            TimeOnAirUplink( dr, n + 2 ), TimeOnAirUplink( dr, n + 3 )
+#define toa_16( dr, n )     toa_4( dr, n ), toa_4( dr, n + 4 ), toa_4( dr, n + 8 ), toa_4( dr, n + 12 )
+#define toa_64( dr, n )     toa_16( dr, n ), toa_16( dr, n + 16 ), toa_16( dr, n + 32 ), toa_16( dr, n + 48 )
+#define toa_row( dr )       { toa_64( dr, 0 ), toa_64( dr, 64 ), toa_64( dr, 128 ), toa_64( dr, 192 ) }
+
+/*!
+ * Uplink time on air per datarate and PHY payload size [us]
+ */
+static constexpr uint32_t TimeOnAirTable[TIME_ON_AIR_DATARATES][TIME_ON_AIR_MAX_SIZE + 1] =
+{
+    toa_row( 0 ), toa_row( 1 ), toa_row( 2 ), toa_row( 3 ),
+    toa_row( 4 ), toa_row( 5 ), toa_row( 6 ), toa_row( 7 )
+};
+
+// Semtech LoRa calculator, 23 bytes PHY payload
+static_assert( TimeOnAirTable[5][23] == 61696 && TimeOnAirTable[4][23] == 113152 &&
+               TimeOnAirTable[3][23] == 205824 && TimeOnAirTable[2][23] == 370688 &&
+               TimeOnAirTable[1][23] == 823296 && TimeOnAirTable[0][23] == 1482752,
+               "EU868 time on air, 23 bytes" );
+static_assert( TimeOnAirTable[6][23] == 30848 && TimeOnAirTable[7][23] == 5440,
+               "EU868 time on air, 23 bytes, SF7 250 kHz and FSK" );
+static_assert( TimeOnAirTable[0][0] == 663552 && TimeOnAirTable[5][255] == 399616,
+               "EU868 time on air, empty and largest frames" );
+
+uint32_t TimeOnAirGet( int8_t datarate, uint8_t size )
+{
+    if( ( datarate < 0 ) || ( datarate >= TIME_ON_AIR_DATARATES ) )
+    {
+        return 0;
+    }
+    return TimeOnAirTable[datarate][size];
+}
+
+#else
+
+/*!
+ * Datarates DR_0 to DR_13 of the US915 plan: SF10 to SF7 at 125 kHz, SF8 at
+ * 500 kHz, RFU (spreading factor 0), SF12 to SF7 at 500 kHz. Computed on
+ * demand, without table.
+ */
+#define TIME_ON_AIR_DATARATES                       14
+
+static const uint8_t TimeOnAirSf[TIME_ON_AIR_DATARATES] = { 10, 9, 8, 7, 8, 0, 0, 0, 12, 11, 10, 9, 8, 7 };
+static const uint16_t TimeOnAirBandwidth[TIME_ON_AIR_DATARATES] = { 125, 125, 125, 125, 500, 0, 0, 0, 500, 500, 500, 500, 500, 500 };
+
+uint32_t TimeOnAirGet( int8_t datarate, uint8_t size )
+{
+    if( ( datarate < 0 ) || ( datarate >= TIME_ON_AIR_DATARATES ) || ( TimeOnAirSf[datarate] == 0 ) )
+    {
+        return 0;
+    }
+    return TimeOnAirCompute( TimeOnAirSf[datarate], TimeOnAirBandwidth[datarate], 1, 8, false, true,
+                             TimeOnAirLowDatarateOpt( TimeOnAirSf[datarate], TimeOnAirBandwidth[datarate] ), size );
+}
+
+#endif
+
+uint32_t TimeOnAirLoRa( uint8_t sf, uint16_t bandwidth, uint8_t codingRate, uint16_t preamble,
+                        bool implicitHeader, bool crcOn, bool lowDatarateOpt, uint8_t size )
+{
+    return TimeOnAirCompute( sf, bandwidth, codingRate, preamble, implicitHeader, crcOn, lowDatarateOpt, size );
+}
@@ -0,0 +1,58 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Time on air of the LoRaWAN frames, from tables computed at
+             compile time per datarate and payload length
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __TIME_ON_AIR_H__
+#define __TIME_ON_AIR_H__
+
+#include "board.h"
+
+/*!
+ * LoRaWAN frame overhead without FOpts: MHDR, DevAddr, FCtrl, FCnt, FPort
+ * and MIC [bytes]
+ */
+#define TIME_ON_AIR_FRAME_OVERHEAD                  13
+
+/*!
+ * Largest PHY payload of the tables [bytes]
+ */
+#define TIME_ON_AIR_MAX_SIZE                        255
+
+/*!
+ * \brief Gets the time on air of an uplink frame: LoRaWAN radio settings,
+ *        8 symbols preamble, coding rate 4/5, explicit header, CRC on
+ *
+ * \param [IN] datarate Datarate of the band plan
+ * \param [IN] size     PHY payload size [bytes]
+ * \retval timeOnAir    Time on air [us], 0 for an unknown datarate
+ */
+uint32_t TimeOnAirGet( int8_t datarate, uint8_t size );
+
+/*!
+ * \brief Computes the time on air of a LoRa frame, SX1276 formula
+ *
+ * \param [IN] sf             Spreading factor, 6 to 12
+ * \param [IN] bandwidth      Bandwidth [kHz], 125, 250 or 500
+ * \param [IN] codingRate     Coding rate 4/(4 + codingRate), 1 to 4
+ * \param [IN] preamble       Programmed preamble length [symbols]
+ * \param [IN] implicitHeader true for the implicit header mode
+ * \param [IN] crcOn          true when the payload CRC is sent
+ * \param [IN] lowDatarateOpt true when the low datarate optimization is on
+ * \param [IN] size           PHY payload size [bytes]
+ * \retval timeOnAir          Time on air [us]
+ */
+uint32_t TimeOnAirLoRa( uint8_t sf, uint16_t bandwidth, uint8_t codingRate, uint16_t preamble,
+                        bool implicitHeader, bool crcOn, bool lowDatarateOpt, uint8_t size );
+
+#endif // __TIME_ON_AIR_H__
@@ -18,7 +18,13 @@ Maintainer: Miguel Luis and Gregory Cristian
 
 #include "LoRaMac.h"
 #include "Comissioning.h"
+#include "LinkEstimator.h"
+#include "TimeOnAir.h"
+#include "DutyCycleScheduler.h"
+#include "ChannelQuality.h"
+#include "SampleAggregator.h"
 #include "SerialDisplay.h"
+#include "EventQueue.h"
 
 /*!
  * Defines the application data transmission duty cycle. 5s, value in [us].
@@ -41,12 +47,28 @@ Maintainer: Miguel Luis and Gregory Cristian
  */
 #define LORAWAN_CONFIRMED_MSG_ON                    true
 
+/*!
+ * Uplink datarate selected by the application link estimator, from the
+ * downlink SNR, the LinkCheck answers and the ACK success rate. The MAC
+ * layer ADR is then disabled.
+ */
+#define LINK_ESTIMATOR_ON                           1
+
+/*!
+ * Fastest datarate the link estimator may select
+ */
+#define LINK_ESTIMATOR_MAX_DATARATE                 DR_5
+
 /*!
  * LoRaWAN Adaptive Data Rate
  *
  * \remark Please note that when ADR is enabled the end-device should be static
  */
+#if( LINK_ESTIMATOR_ON == 1 )
+#define LORAWAN_ADR_ON                              0
+#else
 #define LORAWAN_ADR_ON                              1
+#endif
 
 #if defined( USE_BAND_868 )
 
@@ -73,12 +95,49 @@ Maintainer: Miguel Luis and Gregory Cristian
 
 #endif
 
+/*!
+ * Uplinks scheduled by the application from a ledger of the sub-bands
+ * airtime: each frame is sent as soon as a sub-band allows it, in the free
+ * sub-band of the highest duty cycle, instead of being delayed by the MAC
+ * layer. Requires LORAWAN_DUTYCYCLE_ON.
+ */
+#define DUTY_CYCLE_SCHEDULER_ON                     1
+
+/*!
+ * Uplink channel chosen by the application, among the channels the duty
+ * cycle scheduler allows, from the delivery observed on each of them.
+ * Requires DUTY_CYCLE_SCHEDULER_ON.
+ */
+#define CHANNEL_QUALITY_ON                          1
+
+/*!
+ * Channel selection policy, ChannelQualityPolicyUniform for the MAC layer
+ * uniform choice
+ */
+#define CHANNEL_QUALITY_POLICY                      ChannelQualityPolicyWeighted
+
+#else
+
+#define DUTY_CYCLE_SCHEDULER_ON                     0
+#define CHANNEL_QUALITY_ON                          0
+
 #endif
 
 /*!
- * LoRaWAN application port
+ * Application samples aggregated, several per uplink: a sample is taken every
+ * cycle and the samples are sent when the frame is full, when the oldest one
+ * reaches SAMPLE_AGGREGATOR_MAX_AGE or when the LED state changed
+ */
+#define SAMPLE_AGGREGATION_ON                       1
+
+/*!
+ * LoRaWAN application port, 16 for the aggregated samples
  */
+#if( SAMPLE_AGGREGATION_ON == 1 )
+#define LORAWAN_APP_PORT                            16
+#else
 #define LORAWAN_APP_PORT                            15
+#endif
 
 /*!
  * User application data buffer size
@@ -137,28 +196,74 @@ static uint8_t IsTxConfirmed = LORAWAN_CONFIRMED_MSG_ON;
  */
 static uint32_t TxDutyCycleTime;
 
+/*!
+ * Time on air of the last uplink frame [us], and of all the uplink frames
+ * since startup [us] with their number
+ */
+static uint32_t TxTimeOnAir = 0;
+static TimerTime_t TxTimeOnAirTotal = 0;
+static uint32_t TxUplinks = 0;
+
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+/*!
+ * Uplinks delayed by the duty cycle scheduler until a sub-band was free
+ */
+static uint32_t TxDeferrals = 0;
+#endif
+
 /*!
  * Timer to handle the application data transmission duty cycle
  */
 static TimerEvent_t TxNextPacketTimer;
 
+/*!
+ * Deadline of the next TxNextPacketTimer event. Each cycle is scheduled from
+ * the previous deadline, so the time spent serving the event does not delay
+ * the cadence.
+ */
+static TimerTime_t TxNextPacketDeadline = 0;
+
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 ) || ( SAMPLE_AGGREGATION_ON == 1 )
+/*!
+ * The TxNextPacketTimer event was armed for a delayed uplink, not for a new
+ * cycle
+ */
+static bool TxNextPacketDeferred = false;
+#endif
+
+/*!
+ * Uplink cadence drift measurement: time the last TxNextPacketTimer event was
+ * intended for, as the sum of all the cycles since the first one, and the
+ * accumulated drift of that event from it when it was served [us]
+ */
+static TimerTime_t TxCadenceIntended = 0;
+static int64_t TxCadenceDrift = 0;
+
 /*!
  * Specifies the state of the application LED
  */
 static bool AppLedStateOn = false;
-volatile bool Led3StateChanged = false;
 /*!
  * Timer to handle the state of LED1
  */
 static TimerEvent_t Led1Timer;
-volatile bool Led1State = false;
-volatile bool Led1StateChanged = false;
 /*!
  * Timer to handle the state of LED2
  */
 static TimerEvent_t Led2Timer;
-volatile bool Led2State = false;
-volatile bool Led2StateChanged = false;
+
+#if defined( TIMER_STATS )
+/*!
+ * Timer statistics dump period [us] and first display line
+ */
+#define TIMER_STATS_DUMP_PERIOD                     60000000
+#define TIMER_STATS_DUMP_LINE                       51
+
+/*!
+ * Timer to dump the timer statistics periodically
+ */
+static TimerEvent_t TimerStatsDumpTimer;
+#endif
 
 /*!
  * Indicates if a new packet can be sent
@@ -177,6 +282,184 @@ static enum eDevicState
     DEVICE_STATE_SLEEP
 }DeviceState;
 
+/*!
+ * Main loop idle accounting: time spent waiting for events, and time the
+ * accounting started [us]
+ */
+static TimerTime_t AppIdleTime = 0;
+static TimerTime_t AppIdleOrigin = 0;
+
+/*!
+ * Handles the MAC layer MCPS / MLME events in the main loop: the callbacks,
+ * run in the radio / MAC timer interrupt context, only queue a copy of the
+ * event, in the slots reserved to them if need be. Should the queue still be
+ * full, the event is dropped and counted in the queue TypeOverflows, never
+ * handled out of order in the interrupt. 0: handle them in the callbacks
+ */
+#ifndef MAC_EVENTS_DEFERRED
+#define MAC_EVENTS_DEFERRED                         1
+#endif
+
+/*!
+ * MAC layer callbacks
+ */
+typedef enum eMacCallback
+{
+    MAC_CALLBACK_MCPS_CONFIRM,
+    MAC_CALLBACK_MCPS_INDICATION,
+    MAC_CALLBACK_MLME_CONFIRM,
+    MAC_CALLBACKS
+}MacCallback_t;
+
+/*!
+ * Longest time spent in each MAC layer callback [us]
+ */
+static uint32_t MacCallbackMaxTime[MAC_CALLBACKS];
+
+/*!
+ * Estimated MCU supply current [uA] while running and while sleeping in
+ * AppEventWait; figures of the target datasheet, radio excluded
+ */
+#ifndef APP_CURRENT_RUN
+#define APP_CURRENT_RUN                             7000
+#endif
+#ifndef APP_CURRENT_SLEEP
+#define APP_CURRENT_SLEEP                           2000
+#endif
+
+/*!
+ * \brief Sleeps the core until an event is pending
+ */
+static void AppEventWait( void )
+{
+    TimerTime_t start = TimerGetCurrentTime( );
+
+    __disable_irq( );
+    if( EventQueueIsEmpty( ) == true )
+    {
+#if defined( TIMER_VIRTUAL_CLOCK )
+        __enable_irq( );
+        // Idle, skip straight to the next timer event
+        TimerVirtualClockRunNext( );
+#else
+        // WFI also returns on a masked pending interrupt, which is then served
+        // below: an event posted after the test cannot be missed
+        sleep( );
+#endif
+    }
+    __enable_irq( );
+    AppIdleTime += TimerGetCurrentTime( ) - start;
+}
+
+/*!
+ * \brief Updates the display of the idle CPU duty and of the estimated MCU
+ *        current since startup, and of the event queue statistics
+ */
+static void AppIdleDisplay( void )
+{
+    TimerTime_t elapsed = TimerGetElapsedTime( AppIdleOrigin );
+    EventQueueStats_t stats;
+    uint32_t idle;
+
+    EventQueueGetStats( &stats );
+    SerialDisplayUpdateEventQueue( stats.Posted, stats.Overflows, stats.MaxLatency );
+    SerialDisplayUpdateMacCallbacks( MAC_EVENTS_DEFERRED,
+                                     MacCallbackMaxTime[MAC_CALLBACK_MCPS_CONFIRM],
+                                     MacCallbackMaxTime[MAC_CALLBACK_MCPS_INDICATION],
+                                     MacCallbackMaxTime[MAC_CALLBACK_MLME_CONFIRM] );
+
+    if( elapsed == 0 )
+    {
+        return;
+    }
+    // Idle duty [1/1000]
+    idle = ( uint32_t )( ( AppIdleTime * 1000 ) / elapsed );
+    SerialDisplayUpdateIdle( idle, ( APP_CURRENT_SLEEP * idle + APP_CURRENT_RUN * ( 1000 - idle ) ) / 1000 );
+}
+
+/*!
+ * \brief Updates the display of the uplink time on air
+ */
+static void AppTimeOnAirDisplay( void )
+{
+    TimerTime_t elapsed = TimerGetElapsedTime( AppIdleOrigin );
+
+    if( elapsed == 0 )
+    {
+        return;
+    }
+    // Share of the time spent transmitting [1/100000]
+    SerialDisplayUpdateTimeOnAir( TxTimeOnAir, TxTimeOnAirTotal, TxUplinks,
+                                  ( uint32_t )( ( TxTimeOnAirTotal * 100000 ) / elapsed ) );
+}
+
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+/*!
+ * \brief Updates the display of the sub-bands ledger
+ */
+static void AppDutyCycleDisplay( void )
+{
+    TimerTime_t now = TimerGetCurrentTime( );
+    DutyCycleBand_t band;
+    uint32_t readyIn[DUTY_CYCLE_BANDS];
+    uint8_t i;
+
+    for( i = 0; i < DUTY_CYCLE_BANDS; i++ )
+    {
+        DutyCycleSchedulerGetBand( i, &band );
+        // [ms]
+        readyIn[i] = ( band.ReadyTime > now ) ? ( uint32_t )( ( band.ReadyTime - now ) / 1000 ) : 0;
+    }
+    SerialDisplayUpdateDutyCycleScheduler( readyIn, DUTY_CYCLE_BANDS, TxDeferrals );
+}
+#endif
+
+#if( CHANNEL_QUALITY_ON == 1 )
+/*!
+ * \brief Updates the display of the channel quality table
+ */
+static void AppChannelQualityDisplay( void )
+{
+    ChannelQuality_t quality;
+    uint8_t score[CHANNEL_QUALITY_NB_CHANNELS];
+    uint8_t i;
+
+    for( i = 0; i < CHANNEL_QUALITY_NB_CHANNELS; i++ )
+    {
+        ChannelQualityGet( i, &quality );
+        // [%], 0xFF for a channel never used
+        score[i] = ( quality.Uplinks == 0 ) ? 0xFF : ( uint8_t )( ( quality.Score * 100 ) >> 8 );
+    }
+    SerialDisplayUpdateChannelQuality( ChannelQualityGetPolicy( )->Name, score, CHANNEL_QUALITY_NB_CHANNELS );
+}
+#endif
+
+#if( SAMPLE_AGGREGATION_ON == 1 )
+/*!
+ * \brief Updates the display of the aggregation counters
+ */
+static void AppAggregationDisplay( void )
+{
+    SampleAggregatorStats_t stats;
+
+    SampleAggregatorGetStats( &stats );
+    SerialDisplayUpdateAggregation( &stats );
+}
+#endif
+
+#if( LINK_ESTIMATOR_ON == 1 )
+/*!
+ * \brief Updates the display of the link estimator state
+ */
+static void AppLinkDisplay( void )
+{
+    LinkEstimatorState_t state;
+
+    LinkEstimatorGetState( &state );
+    SerialDisplayUpdateLinkEstimator( &state );
+}
+#endif
+
 /*!
  * LoRaWAN compliance tests support data
  */
@@ -198,11 +481,6 @@ struct ComplianceTest_s
  * SerialDisplay managment variables
  */
 
-/*!
- * Indicates if the MAC layer network join status has changed.
- */
-static bool IsNetworkJoinedStatusUpdate = false;
-
 /*!
  * Strucure containing the Uplink status
  */
@@ -215,7 +493,6 @@ struct sLoRaMacUplinkStatus
     uint8_t *Buffer;
     uint8_t BufferSize;
 }LoRaMacUplinkStatus;
-volatile bool UplinkStatusUpdated = false;
 
 /*!
  * Strucure containing the Downlink status
@@ -230,7 +507,72 @@ struct sLoRaMacDownlinkStatus
     uint8_t *Buffer;
     uint8_t BufferSize;
 }LoRaMacDownlinkStatus;
-volatile bool DownlinkStatusUpdated = false;
+
+/*!
+ * \brief Posts an event without parameters to the main loop, from any context
+ */
+static void AppEventPost( AppEventType_t type )
+{
+    EventQueuePostType( type );
+}
+
+/*!
+ * \brief Posts a LED state change to the main loop
+ */
+static void AppEventPostLed( uint8_t id, bool state )
+{
+    AppEvent_t event;
+
+    event.Type = APP_EVENT_LED;
+    event.Param.Led.Id = id;
+    event.Param.Led.State = state;
+    EventQueuePost( &event );
+}
+
+/*!
+ * \brief Posts a copy of the uplink status to the main loop; the frame
+ *        buffer may be reused before the event is served
+ */
+static void AppEventPostUplink( void )
+{
+    AppEvent_t event;
+    AppUplinkEvent_t *uplink = &event.Param.Uplink;
+
+    event.Type = APP_EVENT_UPLINK;
+    uplink->Acked = LoRaMacUplinkStatus.Acked;
+    uplink->Datarate = LoRaMacUplinkStatus.Datarate;
+    uplink->UplinkCounter = LoRaMacUplinkStatus.UplinkCounter;
+    uplink->Port = LoRaMacUplinkStatus.Port;
+    uplink->BufferSize = MIN( LoRaMacUplinkStatus.BufferSize, EVENT_QUEUE_DATA_MAX_SIZE );
+    if( LoRaMacUplinkStatus.Buffer != NULL )
+    {
+        memcpy1( uplink->Buffer, LoRaMacUplinkStatus.Buffer, uplink->BufferSize );
+    }
+    EventQueuePost( &event );
+}
+
+/*!
+ * \brief Posts a copy of the downlink status to the main loop; the MAC
+ *        layer reuses its reception buffer on the next frame
+ */
+static void AppEventPostDownlink( void )
+{
+    AppEvent_t event;
+    AppDownlinkEvent_t *downlink = &event.Param.Downlink;
+
+    event.Type = APP_EVENT_DOWNLINK;
+    downlink->Rssi = LoRaMacDownlinkStatus.Rssi;
+    downlink->Snr = LoRaMacDownlinkStatus.Snr;
+    downlink->DownlinkCounter = LoRaMacDownlinkStatus.DownlinkCounter;
+    downlink->RxData = LoRaMacDownlinkStatus.RxData;
+    downlink->Port = LoRaMacDownlinkStatus.Port;
+    downlink->BufferSize = MIN( LoRaMacDownlinkStatus.BufferSize, EVENT_QUEUE_DATA_MAX_SIZE );
+    if( LoRaMacDownlinkStatus.Buffer != NULL )
+    {
+        memcpy1( downlink->Buffer, LoRaMacDownlinkStatus.Buffer, downlink->BufferSize );
+    }
+    EventQueuePost( &event );
+}
 
 void SerialDisplayRefresh( void )
 {
@@ -264,9 +606,77 @@ void SerialDisplayRefresh( void )
     SerialDisplayUpdateLedState( 3, AppLedStateOn );
 }
 
+#if defined( TIMER_STATS )
+/*!
+ * \brief Function executed on TimerStatsDump Timeout event
+ */
+static void OnTimerStatsDumpTimerEvent( void )
+{
+    AppEventPost( APP_EVENT_TIMER_STATS );
+}
+
+/*!
+ * \brief Prints the timer statistics below the display; the timers of the
+ *        MAC layer are shown by callback address
+ */
+static void TimerStatsDump( void )
+{
+    TimerEvent_t *obj = NULL;
+    TimerStats_t stats;
+    uint32_t wakeups, intermediate, maxIsrDuration, overlaps;
+    uint8_t line = TIMER_STATS_DUMP_LINE;
+
+    TimerGetWakeupCount( &wakeups, &intermediate );
+    TimerStatsGetDispatch( &maxIsrDuration, &overlaps );
+    SerialDisplayUpdateTimerDispatch( line++, wakeups, intermediate, maxIsrDuration, overlaps );
+
+    while( ( obj = TimerStatsNext( obj ) ) != NULL )
+    {
+        const char *name = NULL;
+
+        if( obj == &TxNextPacketTimer )
+        {
+            name = "TxNextPacket";
+        }
+        else if( obj == &Led1Timer )
+        {
+            name = "Led1";
+        }
+        else if( obj == &Led2Timer )
+        {
+            name = "Led2";
+        }
+        else if( obj == &TimerStatsDumpTimer )
+        {
+            name = "StatsDump";
+        }
+        TimerStatsGet( obj, &stats );
+        SerialDisplayUpdateTimerStats( line++, name, obj->Callback, &stats );
+    }
+}
+#endif
+
+/*!
+ * Indicates an APP_EVENT_SERIAL_RX is queued; SerialRxProcess drains all the
+ * received characters, one event per burst is enough
+ */
+static volatile bool SerialRxPending = false;
+
+/*!
+ * \brief Function executed on serial character reception
+ */
+static void OnSerialRx( void )
+{
+    if( SerialRxPending == false )
+    {
+        SerialRxPending = EventQueuePostType( APP_EVENT_SERIAL_RX );
+    }
+}
+
 void SerialRxProcess( void )
 {
-    if( SerialDisplayReadable( ) == true )
+    SerialRxPending = false;
+    while( SerialDisplayReadable( ) == true )
     {
         switch( SerialDisplayGetChar( ) )
         {
@@ -281,6 +691,88 @@ void SerialRxProcess( void )
     }
 }
 
+/*!
+ * \brief   Gets the datarate of the next uplink
+ *
+ * \retval  datarate Datarate of the link estimator, the default one when
+ *                   the compliance test runs with the MAC layer ADR
+ */
+static int8_t AppGetDatarate( void )
+{
+#if( LINK_ESTIMATOR_ON == 1 )
+    if( ComplianceTest.Running == false )
+    {
+        return LinkEstimatorGetDatarate( );
+    }
+#endif
+    return LORAWAN_DEFAULT_DATARATE;
+}
+
+/*!
+ * \brief   Applies the datarate of the next uplink to the MAC layer
+ */
+static void AppSetDatarate( void )
+{
+#if( LINK_ESTIMATOR_ON == 1 )
+    MibRequestConfirm_t mibReq;
+
+    // The compliance test runs with the MAC layer ADR
+    if( ComplianceTest.Running == false )
+    {
+        // LoRaMacQueryTxPossible checks the payload size against the MAC
+        // layer datarate
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        mibReq.Param.ChannelsDatarate = AppGetDatarate( );
+        LoRaMacMibSetRequestConfirm( &mibReq );
+    }
+#endif
+}
+
+#if( SAMPLE_AGGREGATION_ON == 1 )
+/*!
+ * \brief   Gets the largest application payload of the next uplink, at the
+ *          datarate applied and with the pending MAC commands
+ *
+ * \retval  size Payload size [bytes]
+ */
+static uint8_t AppGetMaxPayload( void )
+{
+    LoRaMacTxInfo_t txInfo;
+    uint8_t size;
+
+    LoRaMacQueryTxPossible( 0, &txInfo );
+    size = MIN( txInfo.MaxPossiblePayload, LORAWAN_APP_DATA_MAX_SIZE );
+#if( LINK_ESTIMATOR_ON == 1 )
+    if( ( LinkEstimatorIsLinkCheckDue( ) == true ) && ( size > 0 ) )
+    {
+        // LinkCheckReq added by SendFrame
+        size--;
+    }
+#endif
+    return size;
+}
+
+/*!
+ * \brief   Adds a sample of the application state to the aggregation, the
+ *          LED state and the last downlink statistics
+ */
+static void AppSampleAdd( void )
+{
+    static bool ledStateOn = false;
+    uint8_t sample[SAMPLE_AGGREGATOR_SAMPLE_SIZE];
+
+    sample[0] = AppLedStateOn;
+    sample[1] = LoRaMacDownlinkStatus.DownlinkCounter >> 8;
+    sample[2] = LoRaMacDownlinkStatus.DownlinkCounter;
+    sample[3] = LoRaMacDownlinkStatus.Rssi >> 8;
+    sample[4] = LoRaMacDownlinkStatus.Rssi;
+    sample[5] = LoRaMacDownlinkStatus.Snr;
+    // A LED state change is reported without waiting for the frame to fill
+    SampleAggregatorAdd( sample, AppLedStateOn != ledStateOn, TimerGetCurrentTime( ) );
+    ledStateOn = AppLedStateOn;
+}
+#endif
+
 /*!
  * \brief   Prepares the payload of the frame
  */
@@ -301,6 +793,11 @@ static void PrepareTxFrame( uint8_t port )
             }
         }
         break;
+#if( SAMPLE_AGGREGATION_ON == 1 )
+    case 16:
+        AppDataSize = SampleAggregatorPack( AppData, AppGetMaxPayload( ), TimerGetCurrentTime( ) );
+        break;
+#endif
     case 224:
         if( ComplianceTest.LinkCheck == true )
         {
@@ -340,14 +837,60 @@ static bool SendFrame( void )
 {
     McpsReq_t mcpsReq;
     LoRaMacTxInfo_t txInfo;
-    
+    int8_t datarate = AppGetDatarate( );
+    uint8_t size;
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+    TimerTime_t now = TimerGetCurrentTime( );
+    int8_t band = -1;
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+    uint16_t budget[CHANNEL_QUALITY_NB_CHANNELS];
+    int8_t channel = -1;
+#endif
+#if( SAMPLE_AGGREGATION_ON == 1 )
+    bool samples = false;
+#endif
+
+    AppSetDatarate( );
+#if( LINK_ESTIMATOR_ON == 1 )
+    if( ( ComplianceTest.Running == false ) && ( LinkEstimatorIsLinkCheckDue( ) == true ) )
+    {
+        MlmeReq_t mlmeReq;
+
+        // Sent along with the uplink
+        mlmeReq.Type = MLME_LINK_CHECK;
+        LoRaMacMlmeRequest( &mlmeReq );
+    }
+#endif
+
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+    if( ComplianceTest.Running == false )
+    {
+#if( CHANNEL_QUALITY_ON == 1 )
+        // The MAC layer sends on the channel selected, charged to its
+        // sub-band
+        channel = ChannelQualitySelect( DutyCycleSchedulerGetChannels( datarate, now, budget ), budget );
+        band = DutyCycleSchedulerSteerChannel( channel );
+#else
+        // The MAC layer picks the channel in the sub-band the ledger charges
+        band = DutyCycleSchedulerSteer( datarate, now );
+#endif
+    }
+    else
+    {
+        DutyCycleSchedulerRelease( );
+    }
+#endif
+
     if( LoRaMacQueryTxPossible( AppDataSize, &txInfo ) != LORAMAC_STATUS_OK )
     {
         // Send empty frame in order to flush MAC commands
         mcpsReq.Type = MCPS_UNCONFIRMED;
         mcpsReq.Req.Unconfirmed.fBuffer = NULL;
         mcpsReq.Req.Unconfirmed.fBufferSize = 0;
-        mcpsReq.Req.Unconfirmed.Datarate = LORAWAN_DEFAULT_DATARATE;
+        mcpsReq.Req.Unconfirmed.Datarate = datarate;
+        // No FPort without payload
+        size = TIME_ON_AIR_FRAME_OVERHEAD - 1;
 
         LoRaMacUplinkStatus.Acked = false;
         LoRaMacUplinkStatus.Port = 0;
@@ -362,6 +905,10 @@ static bool SendFrame( void )
         LoRaMacUplinkStatus.Buffer = AppData;
         LoRaMacUplinkStatus.BufferSize = AppDataSize;
         SerialDisplayUpdateFrameType( IsTxConfirmed );
+        size = TIME_ON_AIR_FRAME_OVERHEAD + AppDataSize;
+#if( SAMPLE_AGGREGATION_ON == 1 )
+        samples = AppPort == LORAWAN_APP_PORT;
+#endif
 
         if( IsTxConfirmed == false )
         {
@@ -369,7 +916,7 @@ static bool SendFrame( void )
             mcpsReq.Req.Unconfirmed.fPort = AppPort;
             mcpsReq.Req.Unconfirmed.fBuffer = AppData;
             mcpsReq.Req.Unconfirmed.fBufferSize = AppDataSize;
-            mcpsReq.Req.Unconfirmed.Datarate = LORAWAN_DEFAULT_DATARATE;
+            mcpsReq.Req.Unconfirmed.Datarate = datarate;
         }
         else
         {
@@ -378,12 +925,32 @@ static bool SendFrame( void )
             mcpsReq.Req.Confirmed.fBuffer = AppData;
             mcpsReq.Req.Confirmed.fBufferSize = AppDataSize;
             mcpsReq.Req.Confirmed.NbTrials = 8;
-            mcpsReq.Req.Confirmed.Datarate = LORAWAN_DEFAULT_DATARATE;
+            mcpsReq.Req.Confirmed.Datarate = datarate;
         }
     }
 
     if( LoRaMacMcpsRequest( &mcpsReq ) == LORAMAC_STATUS_OK )
     {
+        // Pending MAC commands in FOpts are not accounted for
+        TxTimeOnAir = TimeOnAirGet( datarate, size );
+        TxTimeOnAirTotal += TxTimeOnAir;
+        TxUplinks++;
+#if( LINK_ESTIMATOR_ON == 1 )
+        LinkEstimatorOnTx( datarate );
+#endif
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+        DutyCycleSchedulerOnTx( band, TxTimeOnAir, now );
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+        ChannelQualityOnTx( channel );
+#endif
+#if( SAMPLE_AGGREGATION_ON == 1 )
+        if( samples == true )
+        {
+            // Against the frame of a single sample, as without aggregation
+            SampleAggregatorOnSent( TxTimeOnAir, TimeOnAirGet( datarate, TIME_ON_AIR_FRAME_OVERHEAD + LORAWAN_APP_DATA_SIZE ) );
+        }
+#endif
         return false;
     }
     return true;
@@ -399,6 +966,8 @@ static void OnTxNextPacketTimerEvent( void )
 
     TimerStop( &TxNextPacketTimer );
 
+    TxCadenceDrift = ( int64_t )( TimerGetCurrentTime( ) - TxCadenceIntended );
+
     mibReq.Type = MIB_NETWORK_JOINED;
     status = LoRaMacMibGetRequestConfirm( &mibReq );
 
@@ -413,6 +982,7 @@ static void OnTxNextPacketTimerEvent( void )
         {
             DeviceState = DEVICE_STATE_JOIN;
         }
+        AppEventPost( APP_EVENT_DEVICE_STATE );
     }
 }
 
@@ -423,8 +993,7 @@ static void OnLed1TimerEvent( void )
 {
     TimerStop( &Led1Timer );
     // Switch LED 1 OFF
-    Led1State = false;
-    Led1StateChanged = true;
+    AppEventPostLed( 1, false );
 }
 
 /*!
@@ -434,17 +1003,16 @@ static void OnLed2TimerEvent( void )
 {
     TimerStop( &Led2Timer );
     // Switch LED 2 OFF
-    Led2State = false;
-    Led2StateChanged = true;
+    AppEventPostLed( 2, false );
 }
 
 /*!
- * \brief   MCPS-Confirm event function
+ * \brief   MCPS-Confirm event processing, in the main loop context
  *
  * \param   [IN] mcpsConfirm - Pointer to the confirm structure,
  *               containing confirm attributes.
  */
-static void McpsConfirm( McpsConfirm_t *mcpsConfirm )
+static void McpsConfirmProcess( McpsConfirm_t *mcpsConfirm )
 {
     if( mcpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK )
     {
@@ -476,22 +1044,40 @@ static void McpsConfirm( McpsConfirm_t *mcpsConfirm )
         LoRaMacUplinkStatus.UplinkCounter = mcpsConfirm->UpLinkCounter;
 
         // Switch LED 1 ON
-        Led1State = true;
-        Led1StateChanged = true;
+        AppEventPostLed( 1, true );
         TimerStart( &Led1Timer );
 
-        UplinkStatusUpdated = true;
+        AppEventPostUplink( );
     }
+#if( LINK_ESTIMATOR_ON == 1 )
+    if( ( mcpsConfirm->McpsRequest == MCPS_CONFIRMED ) && ( ComplianceTest.Running == false ) )
+    {
+        LinkEstimatorOnConfirm( ( mcpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK ) &&
+                                ( mcpsConfirm->AckReceived == true ) );
+    }
+#endif
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+    DutyCycleSchedulerOnConfirm( mcpsConfirm->TxTimeOnAir, TimerGetCurrentTime( ) );
+#endif
+#if( SAMPLE_AGGREGATION_ON == 1 )
+    SampleAggregatorOnConfirm( ( mcpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK ) &&
+                               ( ( mcpsConfirm->McpsRequest != MCPS_CONFIRMED ) || ( mcpsConfirm->AckReceived == true ) ) );
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+    ChannelQualityOnConfirm( mcpsConfirm->McpsRequest == MCPS_CONFIRMED,
+                             ( mcpsConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK ) &&
+                             ( mcpsConfirm->AckReceived == true ) );
+#endif
     NextTx = true;
 }
 
 /*!
- * \brief   MCPS-Indication event function
+ * \brief   MCPS-Indication event processing, in the main loop context
  *
  * \param   [IN] mcpsIndication - Pointer to the indication structure,
  *               containing indication attributes.
  */
-static void McpsIndication( McpsIndication_t *mcpsIndication )
+static void McpsIndicationProcess( McpsIndication_t *mcpsIndication )
 {
     if( mcpsIndication->Status != LORAMAC_EVENT_INFO_STATUS_OK )
     {
@@ -541,6 +1127,12 @@ static void McpsIndication( McpsIndication_t *mcpsIndication )
         // Divide by 4
         LoRaMacDownlinkStatus.Snr = ( mcpsIndication->Snr & 0xFF ) >> 2;
     }
+#if( LINK_ESTIMATOR_ON == 1 )
+    LinkEstimatorOnDownlink( LoRaMacDownlinkStatus.Rssi, LoRaMacDownlinkStatus.Snr );
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+    ChannelQualityOnDownlink( );
+#endif
     LoRaMacDownlinkStatus.DownlinkCounter++;
     LoRaMacDownlinkStatus.RxData = mcpsIndication->RxData;
     LoRaMacDownlinkStatus.Port = mcpsIndication->Port;
@@ -561,7 +1153,7 @@ static void McpsIndication( McpsIndication_t *mcpsIndication )
             if( mcpsIndication->BufferSize == 1 )
             {
                 AppLedStateOn = mcpsIndication->Buffer[0] & 0x01;
-                Led3StateChanged = true;
+                AppEventPostLed( 3, AppLedStateOn );
             }
             break;
         case 224:
@@ -653,6 +1245,7 @@ static void McpsIndication( McpsIndication_t *mcpsIndication )
 
                         LoRaMacMlmeRequest( &mlmeReq );
                         DeviceState = DEVICE_STATE_SLEEP;
+                        AppEventPost( APP_EVENT_DEVICE_STATE );
                     }
                     break;
                 default:
@@ -666,19 +1259,18 @@ static void McpsIndication( McpsIndication_t *mcpsIndication )
     }
 
     // Switch LED 2 ON for each received downlink
-    Led2State = true;
-    Led2StateChanged = true;
+    AppEventPostLed( 2, true );
     TimerStart( &Led2Timer );
-    DownlinkStatusUpdated = true;
+    AppEventPostDownlink( );
 }
 
 /*!
- * \brief   MLME-Confirm event function
+ * \brief   MLME-Confirm event processing, in the main loop context
  *
  * \param   [IN] mlmeConfirm - Pointer to the confirm structure,
  *               containing confirm attributes.
  */
-static void MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
+static void MlmeConfirmProcess( MlmeConfirm_t *mlmeConfirm )
 {
     if( mlmeConfirm->Status == LORAMAC_EVENT_INFO_STATUS_OK )
     {
@@ -687,15 +1279,19 @@ static void MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
             case MLME_JOIN:
             {
                 // Status is OK, node has joined the network
-                IsNetworkJoinedStatusUpdate = true;
                 DeviceState = DEVICE_STATE_SEND;
                 NextTx = true;
+                AppEventPost( APP_EVENT_NETWORK_JOINED );
+                AppEventPost( APP_EVENT_DEVICE_STATE );
                 break;
             }
             case MLME_LINK_CHECK:
             {
                 // Check DemodMargin
                 // Check NbGateways
+#if( LINK_ESTIMATOR_ON == 1 )
+                LinkEstimatorOnLinkCheck( mlmeConfirm->DemodMargin, mlmeConfirm->NbGateways );
+#endif
                 if( ComplianceTest.Running == true )
                 {
                     ComplianceTest.LinkCheck = true;
@@ -709,7 +1305,162 @@ static void MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
         }
     }
     NextTx = true;
-    UplinkStatusUpdated = true;
+    AppEventPostUplink( );
+}
+
+/*!
+ * \brief Records the time spent in a MAC layer callback
+ *
+ * \param [IN] callback MAC layer callback
+ * \param [IN] start    Time the callback was entered [us]
+ */
+static void MacCallbackTimeRecord( MacCallback_t callback, TimerTime_t start )
+{
+    uint32_t duration = ( uint32_t )TimerGetElapsedTime( start );
+
+    if( duration > MacCallbackMaxTime[callback] )
+    {
+        MacCallbackMaxTime[callback] = duration;
+    }
+}
+
+/*!
+ * \brief   MCPS-Confirm event function, in the MAC interrupt context
+ *
+ * \param   [IN] mcpsConfirm - Pointer to the confirm structure,
+ *               containing confirm attributes.
+ */
+static void McpsConfirm( McpsConfirm_t *mcpsConfirm )
+{
+    TimerTime_t start = TimerGetCurrentTime( );
+#if( MAC_EVENTS_DEFERRED == 1 )
+    AppEvent_t event;
+
+    event.Type = APP_EVENT_MCPS_CONFIRM;
+    event.Param.McpsConfirm = *mcpsConfirm;
+    EventQueuePost( &event );
+#else
+    McpsConfirmProcess( mcpsConfirm );
+#endif
+    MacCallbackTimeRecord( MAC_CALLBACK_MCPS_CONFIRM, start );
+}
+
+/*!
+ * \brief   MCPS-Indication event function, in the MAC interrupt context
+ *
+ * \param   [IN] mcpsIndication - Pointer to the indication structure,
+ *               containing indication attributes.
+ */
+static void McpsIndication( McpsIndication_t *mcpsIndication )
+{
+    TimerTime_t start = TimerGetCurrentTime( );
+#if( MAC_EVENTS_DEFERRED == 1 )
+    AppEvent_t event;
+    AppMcpsIndicationEvent_t *indication = &event.Param.McpsIndication;
+
+    event.Type = APP_EVENT_MCPS_INDICATION;
+    indication->Indication = *mcpsIndication;
+    indication->Indication.BufferSize = MIN( mcpsIndication->BufferSize, EVENT_QUEUE_DATA_MAX_SIZE );
+    if( mcpsIndication->Buffer != NULL )
+    {
+        memcpy1( indication->Buffer, mcpsIndication->Buffer, indication->Indication.BufferSize );
+    }
+    EventQueuePost( &event );
+#else
+    McpsIndicationProcess( mcpsIndication );
+#endif
+    MacCallbackTimeRecord( MAC_CALLBACK_MCPS_INDICATION, start );
+}
+
+/*!
+ * \brief   MLME-Confirm event function, in the MAC interrupt context
+ *
+ * \param   [IN] mlmeConfirm - Pointer to the confirm structure,
+ *               containing confirm attributes.
+ */
+static void MlmeConfirm( MlmeConfirm_t *mlmeConfirm )
+{
+    TimerTime_t start = TimerGetCurrentTime( );
+#if( MAC_EVENTS_DEFERRED == 1 )
+    AppEvent_t event;
+
+    event.Type = APP_EVENT_MLME_CONFIRM;
+    event.Param.MlmeConfirm = *mlmeConfirm;
+    EventQueuePost( &event );
+#else
+    MlmeConfirmProcess( mlmeConfirm );
+#endif
+    MacCallbackTimeRecord( MAC_CALLBACK_MLME_CONFIRM, start );
+}
+
+/*!
+ * \brief Serves an event dequeued by the main loop
+ */
+static void AppEventProcess( AppEvent_t *event )
+{
+    MibRequestConfirm_t mibReq;
+
+    switch( event->Type )
+    {
+        case APP_EVENT_SERIAL_RX:
+            SerialRxProcess( );
+            break;
+        case APP_EVENT_NETWORK_JOINED:
+            mibReq.Type = MIB_NETWORK_JOINED;
+            LoRaMacMibGetRequestConfirm( &mibReq );
+            SerialDisplayUpdateNetworkIsJoined( mibReq.Param.IsNetworkJoined );
+            break;
+        case APP_EVENT_LED:
+            SerialDisplayUpdateLedState( event->Param.Led.Id, event->Param.Led.State );
+            break;
+        case APP_EVENT_UPLINK:
+            {
+                AppUplinkEvent_t *uplink = &event->Param.Uplink;
+
+                SerialDisplayUpdateUplink( uplink->Acked, uplink->Datarate, uplink->UplinkCounter, uplink->Port, uplink->Buffer, uplink->BufferSize );
+                AppIdleDisplay( );
+                AppTimeOnAirDisplay( );
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+                AppDutyCycleDisplay( );
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+                AppChannelQualityDisplay( );
+#endif
+#if( SAMPLE_AGGREGATION_ON == 1 )
+                AppAggregationDisplay( );
+#endif
+#if( LINK_ESTIMATOR_ON == 1 )
+                AppLinkDisplay( );
+#endif
+            }
+            break;
+        case APP_EVENT_DOWNLINK:
+            {
+                AppDownlinkEvent_t *downlink = &event->Param.Downlink;
+
+                SerialDisplayUpdateDownlink( downlink->RxData, downlink->Rssi, downlink->Snr, downlink->DownlinkCounter, downlink->Port, downlink->Buffer, downlink->BufferSize );
+            }
+            break;
+        case APP_EVENT_MCPS_CONFIRM:
+            McpsConfirmProcess( &event->Param.McpsConfirm );
+            break;
+        case APP_EVENT_MCPS_INDICATION:
+            event->Param.McpsIndication.Indication.Buffer = event->Param.McpsIndication.Buffer;
+            McpsIndicationProcess( &event->Param.McpsIndication.Indication );
+            break;
+        case APP_EVENT_MLME_CONFIRM:
+            MlmeConfirmProcess( &event->Param.MlmeConfirm );
+            break;
+#if defined( TIMER_STATS )
+        case APP_EVENT_TIMER_STATS:
+            TimerStatsDump( );
+            break;
+#endif
+        case APP_EVENT_DEVICE_STATE:
+            // Served by the DeviceState switch of the main loop
+        default:
+            break;
+    }
 }
 
 /**
@@ -720,6 +1471,7 @@ int main( void )
     LoRaMacPrimitives_t LoRaMacPrimitives;
     LoRaMacCallback_t LoRaMacCallbacks;
     MibRequestConfirm_t mibReq;
+    AppEvent_t event;
 
     BoardInit( );
     SerialDisplayInit( );
@@ -735,45 +1487,22 @@ int main( void )
     SerialDisplayUpdateKey( 13, AppSKey );
 #endif
 
+    EventQueueInit( );
+    SerialDisplaySetRxHandler( OnSerialRx );
+    AppIdleOrigin = TimerGetCurrentTime( );
+
     DeviceState = DEVICE_STATE_INIT;
 
     while( 1 )
     {
-        SerialRxProcess( );
-        if( IsNetworkJoinedStatusUpdate == true )
-        {
-            IsNetworkJoinedStatusUpdate = false;
-            mibReq.Type = MIB_NETWORK_JOINED;
-            LoRaMacMibGetRequestConfirm( &mibReq );
-            SerialDisplayUpdateNetworkIsJoined( mibReq.Param.IsNetworkJoined );
-        }
-        if( Led1StateChanged == true )
+        // Serve the events in the order they were posted; when the queue
+        // overflowed, an APP_EVENT_DEVICE_STATE may be lost but the state
+        // switch below runs on every pass anyway
+        while( EventQueueGet( &event ) == true )
         {
-            Led1StateChanged = false;
-            SerialDisplayUpdateLedState( 1, Led1State );
+            AppEventProcess( &event );
         }
-        if( Led2StateChanged == true )
-        {
-            Led2StateChanged = false;
-            SerialDisplayUpdateLedState( 2, Led2State );
-        }
-        if( Led3StateChanged == true )
-        {
-            Led3StateChanged = false;
-            SerialDisplayUpdateLedState( 3, AppLedStateOn );
-        }
-        if( UplinkStatusUpdated == true )
-        {
-            UplinkStatusUpdated = false;
-            SerialDisplayUpdateUplink( LoRaMacUplinkStatus.Acked, LoRaMacUplinkStatus.Datarate, LoRaMacUplinkStatus.UplinkCounter, LoRaMacUplinkStatus.Port, LoRaMacUplinkStatus.Buffer, LoRaMacUplinkStatus.BufferSize );
-        }
-        if( DownlinkStatusUpdated == true )
-        {
-            DownlinkStatusUpdated = false;
-            SerialDisplayUpdateLedState( 2, Led2State );
-            SerialDisplayUpdateDownlink( LoRaMacDownlinkStatus.RxData, LoRaMacDownlinkStatus.Rssi, LoRaMacDownlinkStatus.Snr, LoRaMacDownlinkStatus.DownlinkCounter, LoRaMacDownlinkStatus.Port, LoRaMacDownlinkStatus.Buffer, LoRaMacDownlinkStatus.BufferSize );
-        }
-        
+
         switch( DeviceState )
         {
             case DEVICE_STATE_INIT:
@@ -786,12 +1515,23 @@ int main( void )
 
                 TimerInit( &TxNextPacketTimer, OnTxNextPacketTimerEvent );
 
+#if( LINK_ESTIMATOR_ON == 1 )
+                LinkEstimatorInit( LORAWAN_DEFAULT_DATARATE, LINK_ESTIMATOR_MAX_DATARATE );
+#endif
+
                 TimerInit( &Led1Timer, OnLed1TimerEvent );
                 TimerSetValue( &Led1Timer, 25000 );
 
                 TimerInit( &Led2Timer, OnLed2TimerEvent );
                 TimerSetValue( &Led2Timer, 25000 );
 
+#if defined( TIMER_STATS )
+                TimerInit( &TimerStatsDumpTimer, OnTimerStatsDumpTimerEvent );
+                TimerSetValue( &TimerStatsDumpTimer, TIMER_STATS_DUMP_PERIOD );
+                TimerSetPeriodic( &TimerStatsDumpTimer, true );
+                TimerStart( &TimerStatsDumpTimer );
+#endif
+
                 mibReq.Type = MIB_ADR;
                 mibReq.Param.AdrEnable = LORAWAN_ADR_ON;
                 LoRaMacMibSetRequestConfirm( &mibReq );
@@ -818,6 +1558,15 @@ int main( void )
                 LoRaMacMibSetRequestConfirm( &mibReq );
 #endif
 
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+                DutyCycleSchedulerInit( );
+#endif
+#if( CHANNEL_QUALITY_ON == 1 )
+                ChannelQualityInit( &CHANNEL_QUALITY_POLICY );
+#endif
+#endif
+#if( SAMPLE_AGGREGATION_ON == 1 )
+                SampleAggregatorInit( );
 #endif
                 SerialDisplayUpdateActivationMode( OVER_THE_AIR_ACTIVATION );
                 SerialDisplayUpdateAdr( LORAWAN_ADR_ON );
@@ -867,11 +1616,56 @@ int main( void )
 
                 DeviceState = DEVICE_STATE_SEND;
 #endif
-                IsNetworkJoinedStatusUpdate = true;
+                AppEventPost( APP_EVENT_NETWORK_JOINED );
                 break;
             }
             case DEVICE_STATE_SEND:
             {
+#if( SAMPLE_AGGREGATION_ON == 1 )
+                if( ComplianceTest.Running == false )
+                {
+                    if( TxNextPacketDeferred == false )
+                    {
+                        // One sample per cycle
+                        AppSampleAdd( );
+                    }
+                    // Maximum payload at the datarate of the uplink
+                    AppSetDatarate( );
+                    if( ( NextTx == false ) ||
+                        ( SampleAggregatorIsFlushDue( AppGetMaxPayload( ), TimerGetCurrentTime( ) ) == false ) )
+                    {
+                        // No uplink this cycle, the next sample one cycle
+                        // later
+                        TxNextPacketDeferred = false;
+                        TxDutyCycleTime = APP_TX_DUTYCYCLE + randr( -APP_TX_DUTYCYCLE_RND, APP_TX_DUTYCYCLE_RND );
+                        DeviceState = DEVICE_STATE_CYCLE;
+                        break;
+                    }
+                }
+#endif
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 ) || ( SAMPLE_AGGREGATION_ON == 1 )
+                TxNextPacketDeferred = false;
+#endif
+#if( DUTY_CYCLE_SCHEDULER_ON == 1 )
+                if( ( NextTx == true ) && ( ComplianceTest.Running == false ) )
+                {
+                    TimerTime_t now = TimerGetCurrentTime( );
+                    TimerTime_t sendTime = DutyCycleSchedulerGetSendTime( AppGetDatarate( ), now );
+
+                    if( sendTime > now )
+                    {
+                        // No sub-band free yet, send when the first one is.
+                        // The cadence deadline is kept for the next cycle.
+                        TxDeferrals++;
+                        TxNextPacketDeferred = true;
+                        // Before arming the timer, its event may set the
+                        // state as soon as it is started
+                        DeviceState = DEVICE_STATE_SLEEP;
+                        TimerStartAt( &TxNextPacketTimer, sendTime );
+                        break;
+                    }
+                }
+#endif
                 if( NextTx == true )
                 {
                     SerialDisplayUpdateUplinkAcked( false );
@@ -895,16 +1689,30 @@ int main( void )
             }
             case DEVICE_STATE_CYCLE:
             {
+                TimerTime_t now = TimerGetCurrentTime( );
+
                 DeviceState = DEVICE_STATE_SLEEP;
 
-                // Schedule next packet transmission
-                TimerSetValue( &TxNextPacketTimer, TxDutyCycleTime );
-                TimerStart( &TxNextPacketTimer );
+                // Schedule next packet transmission, from the previous deadline
+                if( TxNextPacketDeadline == 0 )
+                {
+                    TxNextPacketDeadline = now;
+                    TxCadenceIntended = now;
+                }
+                TxNextPacketDeadline += TxDutyCycleTime;
+                TxCadenceIntended += TxDutyCycleTime;
+                if( TxNextPacketDeadline <= now )
+                {
+                    // More than a cycle behind, restart the cadence from now
+                    TxNextPacketDeadline = now + TxDutyCycleTime;
+                }
+                TimerStartAt( &TxNextPacketTimer, TxNextPacketDeadline );
                 break;
             }
             case DEVICE_STATE_SLEEP:
             {
                 // Wake up through events
+                AppEventWait( );
                 break;
             }
             default:
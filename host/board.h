@@ -0,0 +1,27 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host stand-in for the target board header, without radio or
+             peripherals
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include "mbed.h"
+#include "system/timer.h"
+#include "system/utilities.h"
+
+#if !defined( USE_BAND_433 ) && !defined( USE_BAND_780 ) && !defined( USE_BAND_868 ) && !defined( USE_BAND_915 ) && !defined( USE_BAND_915_HYBRID )
+#define USE_BAND_868
+#endif
+
+#endif // __BOARD_H__
@@ -0,0 +1,148 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host stand-in for the part of the mbed 2 API used by the
+             system and application modules, for the host tools
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include <stdarg.h>
+#include <time.h>
+#include "mbed.h"
+
+uint32_t HostPrimask = 0;
+
+static Timeout *HostTimeouts = NULL;
+
+uint32_t us_ticker_read( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint32_t )( ( uint64_t )ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+void error( const char *format, ... )
+{
+    va_list args;
+
+    va_start( args, format );
+    vfprintf( stderr, format, args );
+    va_end( args );
+    exit( EXIT_FAILURE );
+}
+
+Timeout::Timeout( void ) : Handler( NULL ), Start( 0 ), Delay( 0 ), Armed( false ), Pending( false )
+{
+    Next = HostTimeouts;
+    HostTimeouts = this;
+}
+
+Timeout::~Timeout( void )
+{
+    Timeout **link;
+
+    for( link = &HostTimeouts; *link != NULL; link = &( *link )->Next )
+    {
+        if( *link == this )
+        {
+            *link = Next;
+            break;
+        }
+    }
+}
+
+void Timeout::attach_us( void ( *handler )( void ), timestamp_t delay )
+{
+    Handler = handler;
+    Start = us_ticker_read( );
+    Delay = delay;
+    Armed = true;
+    Pending = false;
+}
+
+void Timeout::detach( void )
+{
+    Armed = false;
+    Pending = false;
+}
+
+void HostIrqServicePending( void )
+{
+    static bool servicing = false;
+    Timeout *timeout;
+
+    // A handler unmasking the interrupts does not preempt itself
+    if( servicing == true )
+    {
+        return;
+    }
+    servicing = true;
+    timeout = HostTimeouts;
+    while( ( timeout != NULL ) && ( HostPrimask == 0 ) )
+    {
+        if( timeout->Pending == true )
+        {
+            timeout->Pending = false;
+            timeout->Handler( );
+            // The handler may have attached or destroyed any Timeout
+            timeout = HostTimeouts;
+        }
+        else
+        {
+            timeout = timeout->Next;
+        }
+    }
+    servicing = false;
+}
+
+void sleep( void )
+{
+    Timeout *timeout;
+    Timeout *earliest = NULL;
+    uint32_t now = us_ticker_read( );
+    uint32_t remaining = 0;
+
+    for( timeout = HostTimeouts; timeout != NULL; timeout = timeout->Next )
+    {
+        uint32_t elapsed;
+        uint32_t left;
+
+        if( timeout->Pending == true )
+        {
+            // WFI returns at once on a pending interrupt, even masked
+            return;
+        }
+        elapsed = now - timeout->Start;
+        left = ( elapsed < timeout->Delay ) ? timeout->Delay - elapsed : 0;
+
+        if( ( timeout->Armed == true ) && ( ( earliest == NULL ) || ( left < remaining ) ) )
+        {
+            earliest = timeout;
+            remaining = left;
+        }
+    }
+    if( earliest == NULL )
+    {
+        return;
+    }
+    // Spin rather than sleep, the host scheduler latency would dwarf the
+    // timer latency being measured
+    while( ( uint32_t )( us_ticker_read( ) - earliest->Start ) < earliest->Delay )
+    {
+    }
+    earliest->Armed = false;
+    if( HostPrimask != 0 )
+    {
+        earliest->Pending = true;
+        return;
+    }
+    earliest->Handler( );
+}
@@ -0,0 +1,113 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host stand-in for the part of the mbed 2 API used by the
+             system and application modules, for the host tools
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+
+The microsecond ticker runs on the host monotonic clock. The host has no
+interrupts: the Timeout handlers are called from sleep( ), which waits for
+the earliest one as the core waits for its interrupt, so they never preempt
+the thread code. As WFI, sleep( ) still waits with the interrupts disabled;
+the Timeout is then left pending and its handler runs once __enable_irq( ) or
+__set_PRIMASK( 0 ) unmasks it.
+*/
+#ifndef __HOST_MBED_H__
+#define __HOST_MBED_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "us_ticker_api.h"
+
+#define MBED_ASSERT( expr )                         do { if( !( expr ) ) { fprintf( stderr, "%s:%d: assertion %s failed\n", \
+                                                         __FILE__, __LINE__, #expr ); abort( ); } } while( 0 )
+
+/*!
+ * \brief Prints the message and exits, as the mbed fatal error handler
+ */
+void error( const char *format, ... );
+
+/*!
+ * Interrupt mask, PRIMASK of the core
+ */
+extern uint32_t HostPrimask;
+
+/*!
+ * \brief Calls the handlers of the Timeouts that fired while masked
+ */
+void HostIrqServicePending( void );
+
+static inline uint32_t __get_PRIMASK( void )
+{
+    return HostPrimask;
+}
+
+static inline void __set_PRIMASK( uint32_t primask )
+{
+    HostPrimask = primask;
+    if( primask == 0 )
+    {
+        HostIrqServicePending( );
+    }
+}
+
+static inline void __disable_irq( void )
+{
+    HostPrimask = 1;
+}
+
+static inline void __enable_irq( void )
+{
+    HostPrimask = 0;
+    HostIrqServicePending( );
+}
+
+static inline void __DMB( void )
+{
+    __sync_synchronize( );
+}
+
+/*!
+ * \brief Waits for the earliest Timeout and calls its handler, or leaves it
+ *        pending when the interrupts are disabled. Returns at once when one
+ *        is already pending or none is attached
+ */
+void sleep( void );
+
+static inline void __WFI( void )
+{
+    sleep( );
+}
+
+/*!
+ * One shot timeout, function handlers only
+ */
+class Timeout
+{
+public:
+    Timeout( void );
+    ~Timeout( void );
+
+    void attach_us( void ( *handler )( void ), timestamp_t delay );
+    void detach( void );
+
+    void ( *Handler )( void );
+    uint32_t Start;                             // Ticker at attach [us]
+    uint32_t Delay;                             // [us]
+    bool Armed;
+    bool Pending;                               // Fired while masked
+    Timeout *Next;                              // List of all the timeouts
+};
+
+#endif // __HOST_MBED_H__
@@ -0,0 +1,27 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host stand-in for the mbed microsecond ticker API
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __HOST_US_TICKER_API_H__
+#define __HOST_US_TICKER_API_H__
+
+#include <stdint.h>
+
+typedef uint32_t timestamp_t;
+
+/*!
+ * \brief Reads the free running 32 bit microsecond counter
+ */
+uint32_t us_ticker_read( void );
+
+#endif // __HOST_US_TICKER_API_H__
@@ -50,9 +50,14 @@
 #  define HAVE_UINT_32T
 #endif
 
-/* define if you don't want any tables */
-#if 1
-#  define USE_TABLES
+/* table profile, trading flash for speed (the profiles are listed in   */
+/* aes.h); the fast profile is the default on hosts with large caches   */
+#if !defined( AES_TABLE_PROFILE )
+#  if defined( __x86_64__ ) || defined( __i386__ )
+#    define AES_TABLE_PROFILE   AES_TABLES_FAST
+#  else
+#    define AES_TABLE_PROFILE   AES_TABLES_BALANCED
+#  endif
 #endif
 
 /*  On Intel Core 2 duo VERSION_1 is faster */
@@ -62,8 +67,40 @@
 #  define VERSION_1
 #endif
 
+
+/* define to include the AES-NI encryption backend (used only when the CPU */
+/* reports support for it)                                                 */
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __GNUC__ )
+#  define USE_AES_NI
+#endif
+
+/* define to include the bitsliced, constant time SSE2 encryption backend */
+/* (never selected automatically; see aes_set_backend)                    */
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __GNUC__ )
+#  define USE_BITSLICE
+#endif
+
+#if defined( USE_AES_NI ) || defined( USE_BITSLICE )
+#  include <cpuid.h>
+#endif
+#if defined( USE_AES_NI )
+#  include <wmmintrin.h>
+#endif
+#if defined( USE_BITSLICE )
+#  include <emmintrin.h>
+#endif
+
 #include "aes.h"
 
+#if AES_TABLE_PROFILE != AES_TABLES_NONE
+#  define USE_TABLES
+#endif
+
+/* the fast profile adds the 32-bit T-table encryption backend (4 kB) */
+#if AES_TABLE_PROFILE == AES_TABLES_FAST
+#  define USE_T_TABLES
+#endif
+
 //#if defined( HAVE_UINT_32T )
 //  typedef unsigned long uint32_t;
 //#endif
@@ -89,74 +126,6 @@
 
 #if defined( USE_TABLES )
 
-#define sb_data(w) {    /* S Box data values */                            \
-    w(0x63), w(0x7c), w(0x77), w(0x7b), w(0xf2), w(0x6b), w(0x6f), w(0xc5),\
-    w(0x30), w(0x01), w(0x67), w(0x2b), w(0xfe), w(0xd7), w(0xab), w(0x76),\
-    w(0xca), w(0x82), w(0xc9), w(0x7d), w(0xfa), w(0x59), w(0x47), w(0xf0),\
-    w(0xad), w(0xd4), w(0xa2), w(0xaf), w(0x9c), w(0xa4), w(0x72), w(0xc0),\
-    w(0xb7), w(0xfd), w(0x93), w(0x26), w(0x36), w(0x3f), w(0xf7), w(0xcc),\
-    w(0x34), w(0xa5), w(0xe5), w(0xf1), w(0x71), w(0xd8), w(0x31), w(0x15),\
-    w(0x04), w(0xc7), w(0x23), w(0xc3), w(0x18), w(0x96), w(0x05), w(0x9a),\
-    w(0x07), w(0x12), w(0x80), w(0xe2), w(0xeb), w(0x27), w(0xb2), w(0x75),\
-    w(0x09), w(0x83), w(0x2c), w(0x1a), w(0x1b), w(0x6e), w(0x5a), w(0xa0),\
-    w(0x52), w(0x3b), w(0xd6), w(0xb3), w(0x29), w(0xe3), w(0x2f), w(0x84),\
-    w(0x53), w(0xd1), w(0x00), w(0xed), w(0x20), w(0xfc), w(0xb1), w(0x5b),\
-    w(0x6a), w(0xcb), w(0xbe), w(0x39), w(0x4a), w(0x4c), w(0x58), w(0xcf),\
-    w(0xd0), w(0xef), w(0xaa), w(0xfb), w(0x43), w(0x4d), w(0x33), w(0x85),\
-    w(0x45), w(0xf9), w(0x02), w(0x7f), w(0x50), w(0x3c), w(0x9f), w(0xa8),\
-    w(0x51), w(0xa3), w(0x40), w(0x8f), w(0x92), w(0x9d), w(0x38), w(0xf5),\
-    w(0xbc), w(0xb6), w(0xda), w(0x21), w(0x10), w(0xff), w(0xf3), w(0xd2),\
-    w(0xcd), w(0x0c), w(0x13), w(0xec), w(0x5f), w(0x97), w(0x44), w(0x17),\
-    w(0xc4), w(0xa7), w(0x7e), w(0x3d), w(0x64), w(0x5d), w(0x19), w(0x73),\
-    w(0x60), w(0x81), w(0x4f), w(0xdc), w(0x22), w(0x2a), w(0x90), w(0x88),\
-    w(0x46), w(0xee), w(0xb8), w(0x14), w(0xde), w(0x5e), w(0x0b), w(0xdb),\
-    w(0xe0), w(0x32), w(0x3a), w(0x0a), w(0x49), w(0x06), w(0x24), w(0x5c),\
-    w(0xc2), w(0xd3), w(0xac), w(0x62), w(0x91), w(0x95), w(0xe4), w(0x79),\
-    w(0xe7), w(0xc8), w(0x37), w(0x6d), w(0x8d), w(0xd5), w(0x4e), w(0xa9),\
-    w(0x6c), w(0x56), w(0xf4), w(0xea), w(0x65), w(0x7a), w(0xae), w(0x08),\
-    w(0xba), w(0x78), w(0x25), w(0x2e), w(0x1c), w(0xa6), w(0xb4), w(0xc6),\
-    w(0xe8), w(0xdd), w(0x74), w(0x1f), w(0x4b), w(0xbd), w(0x8b), w(0x8a),\
-    w(0x70), w(0x3e), w(0xb5), w(0x66), w(0x48), w(0x03), w(0xf6), w(0x0e),\
-    w(0x61), w(0x35), w(0x57), w(0xb9), w(0x86), w(0xc1), w(0x1d), w(0x9e),\
-    w(0xe1), w(0xf8), w(0x98), w(0x11), w(0x69), w(0xd9), w(0x8e), w(0x94),\
-    w(0x9b), w(0x1e), w(0x87), w(0xe9), w(0xce), w(0x55), w(0x28), w(0xdf),\
-    w(0x8c), w(0xa1), w(0x89), w(0x0d), w(0xbf), w(0xe6), w(0x42), w(0x68),\
-    w(0x41), w(0x99), w(0x2d), w(0x0f), w(0xb0), w(0x54), w(0xbb), w(0x16) }
-
-#define isb_data(w) {   /* inverse S Box data values */                    \
-    w(0x52), w(0x09), w(0x6a), w(0xd5), w(0x30), w(0x36), w(0xa5), w(0x38),\
-    w(0xbf), w(0x40), w(0xa3), w(0x9e), w(0x81), w(0xf3), w(0xd7), w(0xfb),\
-    w(0x7c), w(0xe3), w(0x39), w(0x82), w(0x9b), w(0x2f), w(0xff), w(0x87),\
-    w(0x34), w(0x8e), w(0x43), w(0x44), w(0xc4), w(0xde), w(0xe9), w(0xcb),\
-    w(0x54), w(0x7b), w(0x94), w(0x32), w(0xa6), w(0xc2), w(0x23), w(0x3d),\
-    w(0xee), w(0x4c), w(0x95), w(0x0b), w(0x42), w(0xfa), w(0xc3), w(0x4e),\
-    w(0x08), w(0x2e), w(0xa1), w(0x66), w(0x28), w(0xd9), w(0x24), w(0xb2),\
-    w(0x76), w(0x5b), w(0xa2), w(0x49), w(0x6d), w(0x8b), w(0xd1), w(0x25),\
-    w(0x72), w(0xf8), w(0xf6), w(0x64), w(0x86), w(0x68), w(0x98), w(0x16),\
-    w(0xd4), w(0xa4), w(0x5c), w(0xcc), w(0x5d), w(0x65), w(0xb6), w(0x92),\
-    w(0x6c), w(0x70), w(0x48), w(0x50), w(0xfd), w(0xed), w(0xb9), w(0xda),\
-    w(0x5e), w(0x15), w(0x46), w(0x57), w(0xa7), w(0x8d), w(0x9d), w(0x84),\
-    w(0x90), w(0xd8), w(0xab), w(0x00), w(0x8c), w(0xbc), w(0xd3), w(0x0a),\
-    w(0xf7), w(0xe4), w(0x58), w(0x05), w(0xb8), w(0xb3), w(0x45), w(0x06),\
-    w(0xd0), w(0x2c), w(0x1e), w(0x8f), w(0xca), w(0x3f), w(0x0f), w(0x02),\
-    w(0xc1), w(0xaf), w(0xbd), w(0x03), w(0x01), w(0x13), w(0x8a), w(0x6b),\
-    w(0x3a), w(0x91), w(0x11), w(0x41), w(0x4f), w(0x67), w(0xdc), w(0xea),\
-    w(0x97), w(0xf2), w(0xcf), w(0xce), w(0xf0), w(0xb4), w(0xe6), w(0x73),\
-    w(0x96), w(0xac), w(0x74), w(0x22), w(0xe7), w(0xad), w(0x35), w(0x85),\
-    w(0xe2), w(0xf9), w(0x37), w(0xe8), w(0x1c), w(0x75), w(0xdf), w(0x6e),\
-    w(0x47), w(0xf1), w(0x1a), w(0x71), w(0x1d), w(0x29), w(0xc5), w(0x89),\
-    w(0x6f), w(0xb7), w(0x62), w(0x0e), w(0xaa), w(0x18), w(0xbe), w(0x1b),\
-    w(0xfc), w(0x56), w(0x3e), w(0x4b), w(0xc6), w(0xd2), w(0x79), w(0x20),\
-    w(0x9a), w(0xdb), w(0xc0), w(0xfe), w(0x78), w(0xcd), w(0x5a), w(0xf4),\
-    w(0x1f), w(0xdd), w(0xa8), w(0x33), w(0x88), w(0x07), w(0xc7), w(0x31),\
-    w(0xb1), w(0x12), w(0x10), w(0x59), w(0x27), w(0x80), w(0xec), w(0x5f),\
-    w(0x60), w(0x51), w(0x7f), w(0xa9), w(0x19), w(0xb5), w(0x4a), w(0x0d),\
-    w(0x2d), w(0xe5), w(0x7a), w(0x9f), w(0x93), w(0xc9), w(0x9c), w(0xef),\
-    w(0xa0), w(0xe0), w(0x3b), w(0x4d), w(0xae), w(0x2a), w(0xf5), w(0xb0),\
-    w(0xc8), w(0xeb), w(0xbb), w(0x3c), w(0x83), w(0x53), w(0x99), w(0x61),\
-    w(0x17), w(0x2b), w(0x04), w(0x7e), w(0xba), w(0x77), w(0xd6), w(0x26),\
-    w(0xe1), w(0x69), w(0x14), w(0x63), w(0x55), w(0x21), w(0x0c), w(0x7d) }
-
 #define mm_data(w) {    /* basic data for forming finite field tables */   \
     w(0x00), w(0x01), w(0x02), w(0x03), w(0x04), w(0x05), w(0x06), w(0x07),\
     w(0x08), w(0x09), w(0x0a), w(0x0b), w(0x0c), w(0x0d), w(0x0e), w(0x0f),\
@@ -191,14 +160,82 @@
     w(0xf0), w(0xf1), w(0xf2), w(0xf3), w(0xf4), w(0xf5), w(0xf6), w(0xf7),\
     w(0xf8), w(0xf9), w(0xfa), w(0xfb), w(0xfc), w(0xfd), w(0xfe), w(0xff) }
 
-static const uint8_t sbox[256]  =  sb_data(f1);
+/* compile time finite field arithmetic, used to generate the tables    */
+
+static constexpr uint8_t ct_mul( const uint8_t a, const uint8_t b )
+{
+    return b ? ( uint8_t )( ( b & 1 ? a : 0 ) ^ ct_mul( ( uint8_t )f2(a), b >> 1 ) ) : 0;
+}
+
+/* x^n by square and multiply; x^254 is the inverse of x (and 0 for 0)  */
+static constexpr uint8_t ct_pow( const uint8_t x, const uint8_t n )
+{
+    return n ? ct_mul( ct_pow( ct_mul( x, x ), n >> 1 ), n & 1 ? x : 1 ) : 1;
+}
+
+static constexpr uint8_t ct_rotl( const uint8_t x, const uint8_t n )
+{
+    return ( uint8_t )( ( x << n ) | ( x >> ( 8 - n ) ) );
+}
+
+/* the forward and inverse affine transformations used in the S box    */
+static constexpr uint8_t ct_fwd_affine( const uint8_t x )
+{
+    return ( uint8_t )( 0x63 ^ x ^ ct_rotl( x, 1 ) ^ ct_rotl( x, 2 ) ^ ct_rotl( x, 3 ) ^ ct_rotl( x, 4 ) );
+}
+
+static constexpr uint8_t ct_inv_affine( const uint8_t x )
+{
+    return ( uint8_t )( 0x05 ^ ct_rotl( x, 1 ) ^ ct_rotl( x, 3 ) ^ ct_rotl( x, 6 ) );
+}
+
+static constexpr uint8_t ct_sbox( const uint8_t x )
+{
+    return ct_fwd_affine( ct_pow( x, 254 ) );
+}
+
+static constexpr uint8_t ct_isbox( const uint8_t x )
+{
+    return ct_pow( ct_inv_affine( x ), 254 );
+}
+
+static_assert( ct_sbox( 0x00 ) == 0x63 && ct_sbox( 0x53 ) == 0xed && ct_sbox( 0xff ) == 0x16,
+               "AES S box generation" );
+static_assert( ct_isbox( 0x63 ) == 0x00 && ct_isbox( 0xed ) == 0x53 && ct_isbox( 0x16 ) == 0xff,
+               "AES inverse S box generation" );
+
+#define s1(x)   ct_sbox(x)
+#define s2(x)   f2(ct_sbox(x))
+#define s3(x)   f3(ct_sbox(x))
+#define is1(x)  ct_isbox(x)
+
+static const uint8_t sbox[256] = mm_data(s1);
 
 #if defined( AES_DEC_PREKEYED )
-static const uint8_t isbox[256] = isb_data(f1);
+static const uint8_t isbox[256] = mm_data(is1);
+#endif
+
+#if AES_TABLE_PROFILE != AES_TABLES_MINIMAL
+static const uint8_t gfm2_sbox[256] = mm_data(s2);
+static const uint8_t gfm3_sbox[256] = mm_data(s3);
 #endif
 
-static const uint8_t gfm2_sbox[256] = sb_data(f2);
-static const uint8_t gfm3_sbox[256] = sb_data(f3);
+#if defined( USE_T_TABLES )
+
+/* the four forward round tables combine the S box with the columns of the */
+/* mix columns matrix, the byte in row 0 being the low byte of each word   */
+
+#define bytes2word(b0, b1, b2, b3)  (((uint32_t)(b3) << 24) | ((uint32_t)(b2) << 16) \
+                                    | ((uint32_t)(b1) << 8) | (uint32_t)(b0))
+
+#define u0(x)   bytes2word(s2(x), s1(x), s1(x), s3(x))
+#define u1(x)   bytes2word(s3(x), s2(x), s1(x), s1(x))
+#define u2(x)   bytes2word(s1(x), s3(x), s2(x), s1(x))
+#define u3(x)   bytes2word(s1(x), s1(x), s3(x), s2(x))
+
+static const uint32_t t_fn[4][256] = { mm_data(u0), mm_data(u1), mm_data(u2), mm_data(u3) };
+
+#endif
 
 #if defined( AES_DEC_PREKEYED )
 static const uint8_t gfmul_9[256] = mm_data(f9);
@@ -211,8 +248,13 @@ static const uint8_t gfmul_e[256] = mm_data(fe);
 #if defined( AES_DEC_PREKEYED )
 #define is_box(x)    isbox[(x)]
 #endif
+#if AES_TABLE_PROFILE == AES_TABLES_MINIMAL
+#define gfm2_sb(x)   f2(sbox[(x)])
+#define gfm3_sb(x)   f3(sbox[(x)])
+#else
 #define gfm2_sb(x)   gfm2_sbox[(x)]
 #define gfm3_sb(x)   gfm3_sbox[(x)]
+#endif
 #if defined( AES_DEC_PREKEYED )
 #define gfm_9(x)     gfmul_9[(x)]
 #define gfm_b(x)     gfmul_b[(x)]
@@ -304,6 +346,29 @@ uint8_t inv_affine(const uint8_t x)
 
 #endif
 
+/* report the memory cost of the table profile compiled in */
+
+void aes_get_footprint( aes_footprint *fp )
+{
+    fp->profile = AES_TABLE_PROFILE;
+    fp->flash = 0;
+#if defined( USE_TABLES )
+    fp->flash += sizeof( sbox );
+#if AES_TABLE_PROFILE != AES_TABLES_MINIMAL
+    fp->flash += sizeof( gfm2_sbox ) + sizeof( gfm3_sbox );
+#endif
+#if defined( USE_T_TABLES )
+    fp->flash += sizeof( t_fn );
+#endif
+#if defined( AES_DEC_PREKEYED )
+    fp->flash += sizeof( isbox ) + sizeof( gfmul_9 ) + sizeof( gfmul_b )
+               + sizeof( gfmul_d ) + sizeof( gfmul_e );
+#endif
+#endif
+    fp->ram = 0;
+    fp->context = sizeof( aes_context );
+}
+
 #if defined( HAVE_MEMCPY )
 #  define block_copy_nn(d, s, l)    memcpy(d, s, l)
 #  define block_copy(d, s)          memcpy(d, s, N_BLOCK)
@@ -508,6 +573,11 @@ static void inv_shift_sub_rows( uint8_t st[N_BLOCK] )
 
 #if defined( AES_ENC_PREKEYED ) || defined( AES_DEC_PREKEYED )
 
+#if defined( AES_ENC_PREKEYED ) && defined( USE_BITSLICE )
+static int aes_bitslice_active( void );
+static void bs_expand_key( aes_context ctx[1], uint8_t keylen, uint8_t hi );
+#endif
+
 /*  Set the cipher key for the pre-keyed version */
 
 return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ctx[1] )
@@ -527,6 +597,14 @@ return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ct
     block_copy_nn(ctx->ksch, key, keylen);
     hi = (keylen + 28) << 2;
     ctx->rnd = (hi >> 4) - 1;
+#if defined( AES_ENC_PREKEYED ) && defined( USE_BITSLICE )
+    /* no key dependent S box lookups while the constant time backend is on */
+    if( aes_bitslice_active( ) )
+    {
+        bs_expand_key( ctx, keylen, hi );
+        return 0;
+    }
+#endif
     for( cc = keylen, rc = 1; cc < hi; cc += 4 )
     {   uint8_t tt, t0, t1, t2, t3;
 
@@ -563,9 +641,9 @@ return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ct
 
 #if defined( AES_ENC_PREKEYED )
 
-/*  Encrypt a single block of 16 bytes */
+/*  Encrypt a single block of 16 bytes with byte oriented rounds */
 
-return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
+static return_type aes_encrypt_byte( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
 {
     if( ctx->rnd )
     {
@@ -592,6 +670,981 @@ return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const
     return 0;
 }
 
+/*  Encrypt a number of independent blocks with byte oriented rounds */
+
+static return_type aes_encrypt_blocks_byte( const uint8_t *in, uint8_t *out,
+                         int32_t n_block, const aes_context ctx[1] )
+{
+    while(n_block--)
+    {
+        if(aes_encrypt_byte(in, out, ctx) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        in += N_BLOCK;
+        out += N_BLOCK;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*  Encrypt a number of blocks in place, each under its own key schedule */
+
+static return_type aes_encrypt_multikey_byte( uint8_t *block[], const aes_context *ctx[],
+                         int32_t n_block )
+{
+    while(n_block--)
+    {
+        if(aes_encrypt_byte(*block, *block, *ctx) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        block++;
+        ctx++;
+    }
+    return EXIT_SUCCESS;
+}
+
+#if defined( USE_T_TABLES )
+
+#define word_in(x, c)   bytes2word(((const uint8_t*)(x))[4 * (c)], ((const uint8_t*)(x))[4 * (c) + 1], \
+                                   ((const uint8_t*)(x))[4 * (c) + 2], ((const uint8_t*)(x))[4 * (c) + 3])
+
+#define word_out(x, c, v) do { ((uint8_t*)(x))[4 * (c)    ] = (uint8_t)(v);         \
+                               ((uint8_t*)(x))[4 * (c) + 1] = (uint8_t)((v) >> 8);  \
+                               ((uint8_t*)(x))[4 * (c) + 2] = (uint8_t)((v) >> 16); \
+                               ((uint8_t*)(x))[4 * (c) + 3] = (uint8_t)((v) >> 24); } while( 0 )
+
+/* one round on the four state columns, each output column taking one byte */
+/* from each of the (shifted) input columns                                 */
+
+#define fwd_rnd(x, k, c)  ( t_fn[0][(x)[(c)] & 0xff] \
+                             ^ t_fn[1][((x)[((c) + 1) & 3] >> 8) & 0xff] \
+                             ^ t_fn[2][((x)[((c) + 2) & 3] >> 16) & 0xff] \
+                             ^ t_fn[3][(x)[((c) + 3) & 3] >> 24] ^ word_in(k, c) )
+
+#define fwd_lrnd(x, k, c) ( bytes2word(s_box((x)[(c)] & 0xff), \
+                                          s_box(((x)[((c) + 1) & 3] >> 8) & 0xff), \
+                                          s_box(((x)[((c) + 2) & 3] >> 16) & 0xff), \
+                                          s_box((x)[((c) + 3) & 3] >> 24)) ^ word_in(k, c) )
+
+/*  Encrypt a single block of 16 bytes with 32-bit T-table rounds */
+
+static return_type aes_encrypt_ttable( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    uint32_t s1[N_COL], s2[N_COL];
+    const uint8_t *k = ctx->ksch;
+    uint8_t r;
+
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    s1[0] = word_in(in, 0) ^ word_in(k, 0);
+    s1[1] = word_in(in, 1) ^ word_in(k, 1);
+    s1[2] = word_in(in, 2) ^ word_in(k, 2);
+    s1[3] = word_in(in, 3) ^ word_in(k, 3);
+
+    for( r = 1 ; r < ctx->rnd ; ++r )
+    {
+        k += N_BLOCK;
+        s2[0] = fwd_rnd(s1, k, 0);
+        s2[1] = fwd_rnd(s1, k, 1);
+        s2[2] = fwd_rnd(s1, k, 2);
+        s2[3] = fwd_rnd(s1, k, 3);
+        s1[0] = s2[0]; s1[1] = s2[1]; s1[2] = s2[2]; s1[3] = s2[3];
+    }
+    k += N_BLOCK;
+    s2[0] = fwd_lrnd(s1, k, 0);
+    s2[1] = fwd_lrnd(s1, k, 1);
+    s2[2] = fwd_lrnd(s1, k, 2);
+    s2[3] = fwd_lrnd(s1, k, 3);
+
+    word_out(out, 0, s2[0]);
+    word_out(out, 1, s2[1]);
+    word_out(out, 2, s2[2]);
+    word_out(out, 3, s2[3]);
+    return 0;
+}
+
+/*  Encrypt a number of independent blocks with 32-bit T-table rounds, two
+    blocks at a time so that the table lookups of one block overlap with
+    those of the other
+*/
+
+static return_type aes_encrypt_blocks_ttable( const uint8_t *in, uint8_t *out,
+                         int32_t n_block, const aes_context ctx[1] )
+{
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    for( ; n_block >= 2 ; n_block -= 2 )
+    {
+        uint32_t a1[N_COL], a2[N_COL], b1[N_COL], b2[N_COL];
+        const uint8_t *k = ctx->ksch;
+        const uint8_t *in2 = in + N_BLOCK;
+        uint8_t r;
+
+        a1[0] = word_in(in, 0) ^ word_in(k, 0); b1[0] = word_in(in2, 0) ^ word_in(k, 0);
+        a1[1] = word_in(in, 1) ^ word_in(k, 1); b1[1] = word_in(in2, 1) ^ word_in(k, 1);
+        a1[2] = word_in(in, 2) ^ word_in(k, 2); b1[2] = word_in(in2, 2) ^ word_in(k, 2);
+        a1[3] = word_in(in, 3) ^ word_in(k, 3); b1[3] = word_in(in2, 3) ^ word_in(k, 3);
+
+        for( r = 1 ; r < ctx->rnd ; ++r )
+        {
+            k += N_BLOCK;
+            a2[0] = fwd_rnd(a1, k, 0); b2[0] = fwd_rnd(b1, k, 0);
+            a2[1] = fwd_rnd(a1, k, 1); b2[1] = fwd_rnd(b1, k, 1);
+            a2[2] = fwd_rnd(a1, k, 2); b2[2] = fwd_rnd(b1, k, 2);
+            a2[3] = fwd_rnd(a1, k, 3); b2[3] = fwd_rnd(b1, k, 3);
+            a1[0] = a2[0]; a1[1] = a2[1]; a1[2] = a2[2]; a1[3] = a2[3];
+            b1[0] = b2[0]; b1[1] = b2[1]; b1[2] = b2[2]; b1[3] = b2[3];
+        }
+        k += N_BLOCK;
+        a2[0] = fwd_lrnd(a1, k, 0); b2[0] = fwd_lrnd(b1, k, 0);
+        a2[1] = fwd_lrnd(a1, k, 1); b2[1] = fwd_lrnd(b1, k, 1);
+        a2[2] = fwd_lrnd(a1, k, 2); b2[2] = fwd_lrnd(b1, k, 2);
+        a2[3] = fwd_lrnd(a1, k, 3); b2[3] = fwd_lrnd(b1, k, 3);
+
+        word_out(out, 0, a2[0]); word_out(out + N_BLOCK, 0, b2[0]);
+        word_out(out, 1, a2[1]); word_out(out + N_BLOCK, 1, b2[1]);
+        word_out(out, 2, a2[2]); word_out(out + N_BLOCK, 2, b2[2]);
+        word_out(out, 3, a2[3]); word_out(out + N_BLOCK, 3, b2[3]);
+        in += 2 * N_BLOCK;
+        out += 2 * N_BLOCK;
+    }
+    if( n_block )
+        return aes_encrypt_ttable( in, out, ctx );
+    return 0;
+}
+
+static return_type aes_encrypt_multikey_ttable( uint8_t *block[], const aes_context *ctx[],
+                         int32_t n_block )
+{
+    while(n_block--)
+    {
+        if(aes_encrypt_ttable(*block, *block, *ctx) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        block++;
+        ctx++;
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif
+
+#if defined( USE_AES_NI )
+
+/*  Encrypt a single block of 16 bytes with the AES-NI instructions. The key
+    schedule bytes are already laid out the way AESENC expects them.
+*/
+
+static int aes_ni_supported( void )
+{
+    unsigned int a, b, c, d;
+
+    if( !__get_cpuid( 1, &a, &b, &c, &d ) )
+        return 0;
+    return ( c & bit_AES ) && ( d & bit_SSE2 );
+}
+
+__attribute__(( target( "aes,sse2" ) ))
+static return_type aes_encrypt_aesni( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    const __m128i *k = ( const __m128i* )ctx->ksch;
+    __m128i s;
+    uint8_t r;
+
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    s = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )in ), _mm_loadu_si128( k ) );
+    for( r = 1 ; r < ctx->rnd ; ++r )
+        s = _mm_aesenc_si128( s, _mm_loadu_si128( k + r ) );
+    s = _mm_aesenclast_si128( s, _mm_loadu_si128( k + r ) );
+    _mm_storeu_si128( ( __m128i* )out, s );
+    return 0;
+}
+
+/*  Encrypt a number of independent blocks with the AES-NI instructions.
+    Four blocks are kept in flight to hide the latency of AESENC.
+*/
+
+__attribute__(( target( "aes,sse2" ) ))
+static return_type aes_encrypt_blocks_aesni( const uint8_t *in, uint8_t *out,
+                         int32_t n_block, const aes_context ctx[1] )
+{
+    const __m128i *k = ( const __m128i* )ctx->ksch;
+    uint8_t r;
+
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    for( ; n_block >= 4 ; n_block -= 4 )
+    {
+        __m128i kr = _mm_loadu_si128( k );
+        __m128i s0 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )in ), kr );
+        __m128i s1 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )in + 1 ), kr );
+        __m128i s2 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )in + 2 ), kr );
+        __m128i s3 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )in + 3 ), kr );
+
+        for( r = 1 ; r < ctx->rnd ; ++r )
+        {
+            kr = _mm_loadu_si128( k + r );
+            s0 = _mm_aesenc_si128( s0, kr );
+            s1 = _mm_aesenc_si128( s1, kr );
+            s2 = _mm_aesenc_si128( s2, kr );
+            s3 = _mm_aesenc_si128( s3, kr );
+        }
+        kr = _mm_loadu_si128( k + r );
+        _mm_storeu_si128( ( __m128i* )out, _mm_aesenclast_si128( s0, kr ) );
+        _mm_storeu_si128( ( __m128i* )out + 1, _mm_aesenclast_si128( s1, kr ) );
+        _mm_storeu_si128( ( __m128i* )out + 2, _mm_aesenclast_si128( s2, kr ) );
+        _mm_storeu_si128( ( __m128i* )out + 3, _mm_aesenclast_si128( s3, kr ) );
+        in += 4 * N_BLOCK;
+        out += 4 * N_BLOCK;
+    }
+    for( ; n_block > 0 ; --n_block )
+    {
+        aes_encrypt_aesni( in, out, ctx );
+        in += N_BLOCK;
+        out += N_BLOCK;
+    }
+    return 0;
+}
+
+/*  Encrypt a number of blocks in place, each under its own key schedule,
+    four at a time. Groups whose schedules have different round counts are
+    done one block at a time.
+*/
+
+__attribute__(( target( "aes,sse2" ) ))
+static return_type aes_encrypt_multikey_aesni( uint8_t *block[], const aes_context *ctx[],
+                         int32_t n_block )
+{
+    uint8_t r;
+
+    for( ; n_block >= 4 ; n_block -= 4, block += 4, ctx += 4 )
+    {
+        const __m128i *k0 = ( const __m128i* )ctx[0]->ksch;
+        const __m128i *k1 = ( const __m128i* )ctx[1]->ksch;
+        const __m128i *k2 = ( const __m128i* )ctx[2]->ksch;
+        const __m128i *k3 = ( const __m128i* )ctx[3]->ksch;
+        uint8_t rnd = ctx[0]->rnd;
+        __m128i s0, s1, s2, s3;
+
+        if( !rnd || ctx[1]->rnd != rnd || ctx[2]->rnd != rnd || ctx[3]->rnd != rnd )
+        {
+            for( r = 0 ; r < 4 ; ++r )
+                if( aes_encrypt_aesni( block[r], block[r], ctx[r] ) != EXIT_SUCCESS )
+                    return EXIT_FAILURE;
+            continue;
+        }
+
+        s0 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )block[0] ), _mm_loadu_si128( k0 ) );
+        s1 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )block[1] ), _mm_loadu_si128( k1 ) );
+        s2 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )block[2] ), _mm_loadu_si128( k2 ) );
+        s3 = _mm_xor_si128( _mm_loadu_si128( ( const __m128i* )block[3] ), _mm_loadu_si128( k3 ) );
+        for( r = 1 ; r < rnd ; ++r )
+        {
+            s0 = _mm_aesenc_si128( s0, _mm_loadu_si128( k0 + r ) );
+            s1 = _mm_aesenc_si128( s1, _mm_loadu_si128( k1 + r ) );
+            s2 = _mm_aesenc_si128( s2, _mm_loadu_si128( k2 + r ) );
+            s3 = _mm_aesenc_si128( s3, _mm_loadu_si128( k3 + r ) );
+        }
+        _mm_storeu_si128( ( __m128i* )block[0], _mm_aesenclast_si128( s0, _mm_loadu_si128( k0 + r ) ) );
+        _mm_storeu_si128( ( __m128i* )block[1], _mm_aesenclast_si128( s1, _mm_loadu_si128( k1 + r ) ) );
+        _mm_storeu_si128( ( __m128i* )block[2], _mm_aesenclast_si128( s2, _mm_loadu_si128( k2 + r ) ) );
+        _mm_storeu_si128( ( __m128i* )block[3], _mm_aesenclast_si128( s3, _mm_loadu_si128( k3 + r ) ) );
+    }
+    for( ; n_block > 0 ; --n_block, ++block, ++ctx )
+        if( aes_encrypt_aesni( *block, *block, *ctx ) != EXIT_SUCCESS )
+            return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+#endif
+
+#if defined( USE_BITSLICE )
+
+/*  Constant time bitsliced encryption after T. Pornin's 'ct64' design, with
+    each 64-bit word widened to an SSE2 register so that eight blocks (two
+    groups of four, one group per 64-bit lane) are encrypted in one pass.
+    Bit plane j of q[] holds bit j of every state byte of the eight blocks;
+    the S box is the Boyar-Peralta circuit, so neither the key nor the data
+    ever selects a memory address or a branch.
+*/
+
+#define BS_LANES    8
+#define bs_mask(m)  _mm_set1_epi64x( ( long long )( m ) )
+
+typedef __m128i bs_word;
+
+static int aes_sse2_supported( void )
+{
+    unsigned int a, b, c, d;
+
+    if( !__get_cpuid( 1, &a, &b, &c, &d ) )
+        return 0;
+    return ( d & bit_SSE2 ) != 0;
+}
+
+/*  Spread the four little endian words of a block into two 64-bit words,
+    the even and odd byte columns interleaved as ct64 expects
+*/
+
+static void bs_interleave_in( uint64_t *q0, uint64_t *q1, const uint8_t b[N_BLOCK] )
+{
+    uint64_t x[4];
+    uint8_t i;
+
+    for( i = 0 ; i < 4 ; ++i )
+    {
+        x[i] = ( uint64_t )b[4 * i] | ( ( uint64_t )b[4 * i + 1] << 8 )
+             | ( ( uint64_t )b[4 * i + 2] << 16 ) | ( ( uint64_t )b[4 * i + 3] << 24 );
+        x[i] |= x[i] << 16;
+        x[i] &= 0x0000FFFF0000FFFFull;
+        x[i] |= x[i] << 8;
+        x[i] &= 0x00FF00FF00FF00FFull;
+    }
+    *q0 = x[0] | ( x[2] << 8 );
+    *q1 = x[1] | ( x[3] << 8 );
+}
+
+static void bs_interleave_out( uint8_t b[N_BLOCK], uint64_t q0, uint64_t q1 )
+{
+    uint64_t x[4];
+    uint8_t i;
+
+    x[0] = q0 & 0x00FF00FF00FF00FFull;
+    x[1] = q1 & 0x00FF00FF00FF00FFull;
+    x[2] = ( q0 >> 8 ) & 0x00FF00FF00FF00FFull;
+    x[3] = ( q1 >> 8 ) & 0x00FF00FF00FF00FFull;
+    for( i = 0 ; i < 4 ; ++i )
+    {
+        uint32_t w;
+
+        x[i] |= x[i] >> 8;
+        x[i] &= 0x0000FFFF0000FFFFull;
+        w = ( uint32_t )x[i] | ( uint32_t )( x[i] >> 16 );
+        b[4 * i] = ( uint8_t )w;
+        b[4 * i + 1] = ( uint8_t )( w >> 8 );
+        b[4 * i + 2] = ( uint8_t )( w >> 16 );
+        b[4 * i + 3] = ( uint8_t )( w >> 24 );
+    }
+}
+
+/*  Transpose between the interleaved words and the bit planes (the
+    transform is its own inverse)
+*/
+
+#define bs_swap(cl, ch, s, x, y)  do { bs_word a_ = (x), b_ = (y); \
+    (x) = _mm_or_si128( _mm_and_si128( a_, bs_mask(cl) ), _mm_slli_epi64( _mm_and_si128( b_, bs_mask(cl) ), s ) ); \
+    (y) = _mm_or_si128( _mm_srli_epi64( _mm_and_si128( a_, bs_mask(ch) ), s ), _mm_and_si128( b_, bs_mask(ch) ) ); \
+    } while( 0 )
+
+#define bs_swap2(x, y)  bs_swap(0x5555555555555555ull, 0xAAAAAAAAAAAAAAAAull, 1, x, y)
+#define bs_swap4(x, y)  bs_swap(0x3333333333333333ull, 0xCCCCCCCCCCCCCCCCull, 2, x, y)
+#define bs_swap8(x, y)  bs_swap(0x0F0F0F0F0F0F0F0Full, 0xF0F0F0F0F0F0F0F0ull, 4, x, y)
+
+__attribute__(( target( "sse2" ) ))
+static void bs_ortho( bs_word q[8] )
+{
+    bs_swap2( q[0], q[1] );
+    bs_swap2( q[2], q[3] );
+    bs_swap2( q[4], q[5] );
+    bs_swap2( q[6], q[7] );
+
+    bs_swap4( q[0], q[2] );
+    bs_swap4( q[1], q[3] );
+    bs_swap4( q[4], q[6] );
+    bs_swap4( q[5], q[7] );
+
+    bs_swap8( q[0], q[4] );
+    bs_swap8( q[1], q[5] );
+    bs_swap8( q[2], q[6] );
+    bs_swap8( q[3], q[7] );
+}
+
+/*  Load eight blocks into bit planes; blocks 0-3 go to the low 64-bit
+    lane and blocks 4-7 to the high lane
+*/
+
+__attribute__(( target( "sse2" ) ))
+static void bs_load( bs_word q[8], const uint8_t * const blk[BS_LANES] )
+{
+    uint64_t lo[8], hi[8];
+    uint8_t i;
+
+    for( i = 0 ; i < 4 ; ++i )
+    {
+        bs_interleave_in( &lo[i], &lo[i + 4], blk[i] );
+        bs_interleave_in( &hi[i], &hi[i + 4], blk[i + 4] );
+    }
+    for( i = 0 ; i < 8 ; ++i )
+        q[i] = _mm_set_epi64x( ( long long )hi[i], ( long long )lo[i] );
+    bs_ortho( q );
+}
+
+__attribute__(( target( "sse2" ) ))
+static void bs_store( uint8_t * const blk[BS_LANES], const bs_word s[8], uint8_t n )
+{
+    uint64_t w[8][2];
+    bs_word q[8];
+    uint8_t i;
+
+    for( i = 0 ; i < 8 ; ++i )
+        q[i] = s[i];
+    bs_ortho( q );
+    for( i = 0 ; i < 8 ; ++i )
+        _mm_storeu_si128( ( __m128i* )w[i], q[i] );
+    for( i = 0 ; i < n ; ++i )
+        bs_interleave_out( blk[i], w[i & 3][i >> 2], w[( i & 3 ) + 4][i >> 2] );
+}
+
+/*  The S box on all 128 bytes of the eight blocks at once */
+
+__attribute__(( target( "sse2" ) ))
+static void bs_sub_bytes( bs_word q[8] )
+{
+    bs_word x0, x1, x2, x3, x4, x5, x6, x7;
+    bs_word y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    bs_word y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    bs_word y20, y21;
+    bs_word z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    bs_word z10, z11, z12, z13, z14, z15, z16, z17;
+    bs_word t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    bs_word t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    bs_word t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    bs_word t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    bs_word t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    bs_word t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    bs_word t60, t61, t62, t63, t64, t65, t66, t67;
+    bs_word s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    /* top linear transformation */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /* non-linear section */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /* bottom linear transformation */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+__attribute__(( target( "sse2" ) ))
+static void bs_shift_rows( bs_word q[8] )
+{
+    uint8_t i;
+
+    for( i = 0 ; i < 8 ; ++i )
+    {
+        bs_word x = q[i];
+
+        q[i] = _mm_and_si128( x, bs_mask( 0x000000000000FFFFull ) )
+             | _mm_srli_epi64( _mm_and_si128( x, bs_mask( 0x00000000FFF00000ull ) ), 4 )
+             | _mm_slli_epi64( _mm_and_si128( x, bs_mask( 0x00000000000F0000ull ) ), 12 )
+             | _mm_srli_epi64( _mm_and_si128( x, bs_mask( 0x0000FF0000000000ull ) ), 8 )
+             | _mm_slli_epi64( _mm_and_si128( x, bs_mask( 0x000000FF00000000ull ) ), 8 )
+             | _mm_srli_epi64( _mm_and_si128( x, bs_mask( 0xF000000000000000ull ) ), 12 )
+             | _mm_slli_epi64( _mm_and_si128( x, bs_mask( 0x0FFF000000000000ull ) ), 4 );
+    }
+}
+
+/* rotate each 64-bit lane by 16 and by 32 bits (one and two rows) */
+#define bs_rot16(x)     ( _mm_srli_epi64( x, 16 ) | _mm_slli_epi64( x, 48 ) )
+#define bs_rot32(x)     _mm_shuffle_epi32( x, 0xB1 )
+
+__attribute__(( target( "sse2" ) ))
+static void bs_mix_columns( bs_word q[8] )
+{
+    bs_word r[8];
+    bs_word q7 = q[7];
+    uint8_t i;
+
+    for( i = 0 ; i < 8 ; ++i )
+        r[i] = bs_rot16( q[i] );
+
+    q[7] = q[6] ^ r[6] ^ r[7] ^ bs_rot32( q[7] ^ r[7] );
+    q[6] = q[5] ^ r[5] ^ r[6] ^ bs_rot32( q[6] ^ r[6] );
+    q[5] = q[4] ^ r[4] ^ r[5] ^ bs_rot32( q[5] ^ r[5] );
+    q[4] = q[3] ^ r[3] ^ q7 ^ r[7] ^ r[4] ^ bs_rot32( q[4] ^ r[4] );
+    q[3] = q[2] ^ r[2] ^ q7 ^ r[7] ^ r[3] ^ bs_rot32( q[3] ^ r[3] );
+    q[2] = q[1] ^ r[1] ^ r[2] ^ bs_rot32( q[2] ^ r[2] );
+    q[1] = q[0] ^ r[0] ^ q7 ^ r[7] ^ r[1] ^ bs_rot32( q[1] ^ r[1] );
+    q[0] = q7 ^ r[7] ^ r[0] ^ bs_rot32( q[0] ^ r[0] );
+}
+
+__attribute__(( target( "sse2" ) ))
+static void bs_add_round_key( bs_word q[8], const bs_word k[8] )
+{
+    uint8_t i;
+
+    for( i = 0 ; i < 8 ; ++i )
+        q[i] ^= k[i];
+}
+
+__attribute__(( target( "sse2" ) ))
+static void bs_encrypt( bs_word q[8], const bs_word *sk, uint8_t rnd )
+{
+    uint8_t r;
+
+    bs_add_round_key( q, sk );
+    for( r = 1 ; r < rnd ; ++r )
+    {
+        bs_sub_bytes( q );
+        bs_shift_rows( q );
+        bs_mix_columns( q );
+        bs_add_round_key( q, sk + 8 * r );
+    }
+    bs_sub_bytes( q );
+    bs_shift_rows( q );
+    bs_add_round_key( q, sk + 8 * rnd );
+}
+
+/*  Bitslice the round keys; lane i of the result uses ctx[i]. A single
+    key schedule is handled by passing the same context in every lane.
+*/
+
+__attribute__(( target( "sse2" ) ))
+static void bs_key_schedule( bs_word *sk, const aes_context * const ctx[BS_LANES] )
+{
+    const uint8_t *k[BS_LANES];
+    uint8_t r, i;
+
+    for( r = 0 ; r <= ctx[0]->rnd ; ++r )
+    {
+        for( i = 0 ; i < BS_LANES ; ++i )
+            k[i] = ctx[i]->ksch + r * N_BLOCK;
+        bs_load( sk + 8 * r, k );
+    }
+}
+
+static const uint8_t bs_zero[N_BLOCK] = { 0 };
+
+/*  Encrypt up to eight blocks; unused lanes encrypt a block of zeros */
+
+__attribute__(( target( "sse2" ) ))
+static void bs_encrypt_lanes( const uint8_t *in[BS_LANES], uint8_t *out[BS_LANES], uint8_t n,
+                         const bs_word *sk, uint8_t rnd )
+{
+    const uint8_t *p[BS_LANES];
+    bs_word q[8];
+    uint8_t i;
+
+    for( i = 0 ; i < BS_LANES ; ++i )
+        p[i] = i < n ? in[i] : bs_zero;
+    bs_load( q, p );
+    bs_encrypt( q, sk, rnd );
+    bs_store( out, q, n );
+}
+
+__attribute__(( target( "sse2" ) ))
+static return_type aes_encrypt_blocks_bitslice( const uint8_t *in, uint8_t *out,
+                         int32_t n_block, const aes_context ctx[1] )
+{
+    bs_word sk[( N_MAX_ROUNDS + 1 ) * 8];
+    const aes_context *c[BS_LANES];
+    const uint8_t *p[BS_LANES];
+    uint8_t *o[BS_LANES];
+    uint8_t i, n;
+
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+
+    for( i = 0 ; i < BS_LANES ; ++i )
+        c[i] = ctx;
+    bs_key_schedule( sk, c );
+    for( ; n_block > 0 ; n_block -= n )
+    {
+        n = n_block < BS_LANES ? ( uint8_t )n_block : BS_LANES;
+        for( i = 0 ; i < n ; ++i )
+        {
+            p[i] = in + i * N_BLOCK;
+            o[i] = out + i * N_BLOCK;
+        }
+        bs_encrypt_lanes( p, o, n, sk, ctx->rnd );
+        in += n * N_BLOCK;
+        out += n * N_BLOCK;
+    }
+    return 0;
+}
+
+/*  SubWord of the key expansion, the word (first byte in the low bits) in
+    the first column of a block
+*/
+
+__attribute__(( target( "sse2" ) ))
+static uint32_t bs_sub_word( uint32_t w )
+{
+    uint8_t b[N_BLOCK] = { ( uint8_t )w, ( uint8_t )( w >> 8 ), ( uint8_t )( w >> 16 ), ( uint8_t )( w >> 24 ) };
+    const uint8_t *p[BS_LANES];
+    uint8_t *o[BS_LANES];
+    bs_word q[8];
+    uint8_t i;
+
+    for( i = 0 ; i < BS_LANES ; ++i )
+    {
+        p[i] = b;
+        o[i] = b;
+    }
+    bs_load( q, p );
+    bs_sub_bytes( q );
+    bs_store( o, q, 1 );
+    return ( uint32_t )b[0] | ( ( uint32_t )b[1] << 8 ) | ( ( uint32_t )b[2] << 16 ) | ( ( uint32_t )b[3] << 24 );
+}
+
+/*  The key expansion of aes_set_key with SubWord through the bitsliced
+    S box, so that keying is constant time as well. The table loop of
+    aes_set_key is kept for the other backends: packing the bytes into a
+    word lengthens its serial dependency chain.
+*/
+
+static void bs_expand_key( aes_context ctx[1], uint8_t keylen, uint8_t hi )
+{
+    uint8_t cc, tt, rc;
+    uint32_t w;
+
+    for( cc = keylen, rc = 1; cc < hi; cc += 4 )
+    {
+        w = ( uint32_t )ctx->ksch[cc - 4] | ( ( uint32_t )ctx->ksch[cc - 3] << 8 )
+          | ( ( uint32_t )ctx->ksch[cc - 2] << 16 ) | ( ( uint32_t )ctx->ksch[cc - 1] << 24 );
+        if( cc % keylen == 0 )
+        {
+            w = bs_sub_word( ( w >> 8 ) | ( w << 24 ) ) ^ rc;
+            rc = f2(rc);
+        }
+        else if( keylen > 24 && cc % keylen == 16 )
+        {
+            w = bs_sub_word( w );
+        }
+        tt = cc - keylen;
+        ctx->ksch[cc + 0] = ctx->ksch[tt + 0] ^ ( uint8_t )w;
+        ctx->ksch[cc + 1] = ctx->ksch[tt + 1] ^ ( uint8_t )( w >> 8 );
+        ctx->ksch[cc + 2] = ctx->ksch[tt + 2] ^ ( uint8_t )( w >> 16 );
+        ctx->ksch[cc + 3] = ctx->ksch[tt + 3] ^ ( uint8_t )( w >> 24 );
+    }
+}
+
+/*  A single block costs as much as eight; this is only here so that the
+    whole backend stays constant time
+*/
+
+static return_type aes_encrypt_bitslice( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    return aes_encrypt_blocks_bitslice( in, out, 1, ctx );
+}
+
+/*  Eight blocks per pass, each lane with its own bitsliced key schedule.
+    A group whose schedules have different round counts is split up.
+*/
+
+__attribute__(( target( "sse2" ) ))
+static return_type aes_encrypt_multikey_bitslice( uint8_t *block[], const aes_context *ctx[],
+                         int32_t n_block )
+{
+    bs_word sk[( N_MAX_ROUNDS + 1 ) * 8];
+    const aes_context *c[BS_LANES];
+    uint8_t i, n;
+
+    for( ; n_block > 0 ; n_block -= n, block += n, ctx += n )
+    {
+        n = n_block < BS_LANES ? ( uint8_t )n_block : BS_LANES;
+        for( i = 0 ; i < BS_LANES ; ++i )
+        {
+            c[i] = i < n ? ctx[i] : ctx[0];
+            if( c[i]->rnd != ctx[0]->rnd )
+                break;
+        }
+        if( i < BS_LANES || !ctx[0]->rnd )
+        {
+            for( i = 0 ; i < n ; ++i )
+                if( aes_encrypt_bitslice( block[i], block[i], ctx[i] ) != EXIT_SUCCESS )
+                    return EXIT_FAILURE;
+            continue;
+        }
+        bs_key_schedule( sk, c );
+        bs_encrypt_lanes( ( const uint8_t** )block, block, n, sk, ctx[0]->rnd );
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif
+
+/*  Backend selection. The first call to aes_encrypt (or aes_get_backend)
+    picks the fastest backend compiled in and supported by the CPU.
+*/
+
+typedef struct
+{
+    aes_backend id;
+    return_type ( *encrypt )( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] );
+    return_type ( *encrypt_blocks )( const uint8_t *in, uint8_t *out, int32_t n_block, const aes_context ctx[1] );
+    return_type ( *encrypt_multikey )( uint8_t *block[], const aes_context *ctx[], int32_t n_block );
+    uint8_t multikey_lanes;     /* blocks encrypt_multikey runs side by side */
+} aes_backend_ops;
+
+static const aes_backend_ops aes_byte_ops =
+    { AES_BACKEND_BYTE, aes_encrypt_byte, aes_encrypt_blocks_byte, aes_encrypt_multikey_byte, 1 };
+#if defined( USE_T_TABLES )
+static const aes_backend_ops aes_ttable_ops =
+    { AES_BACKEND_TTABLE, aes_encrypt_ttable, aes_encrypt_blocks_ttable, aes_encrypt_multikey_ttable, 1 };
+#endif
+#if defined( USE_AES_NI )
+static const aes_backend_ops aes_aesni_ops =
+    { AES_BACKEND_AESNI, aes_encrypt_aesni, aes_encrypt_blocks_aesni, aes_encrypt_multikey_aesni, 4 };
+#endif
+#if defined( USE_BITSLICE )
+static const aes_backend_ops aes_bitslice_ops =
+    { AES_BACKEND_BITSLICE, aes_encrypt_bitslice, aes_encrypt_blocks_bitslice, aes_encrypt_multikey_bitslice, BS_LANES };
+#endif
+
+static const aes_backend_ops *aes_ops = NULL;
+
+#if defined( USE_BITSLICE )
+static int aes_bitslice_active( void )
+{
+    return aes_ops == &aes_bitslice_ops;
+}
+#endif
+
+static void aes_select_backend( void )
+{
+    if( aes_set_backend( AES_BACKEND_AESNI ) == 0 )
+        return;
+    if( aes_set_backend( AES_BACKEND_TTABLE ) == 0 )
+        return;
+    aes_set_backend( AES_BACKEND_BYTE );
+}
+
+return_type aes_set_backend( aes_backend backend )
+{
+    switch( backend )
+    {
+    case AES_BACKEND_BYTE:
+        aes_ops = &aes_byte_ops;
+        return 0;
+#if defined( USE_T_TABLES )
+    case AES_BACKEND_TTABLE:
+        aes_ops = &aes_ttable_ops;
+        return 0;
+#endif
+#if defined( USE_AES_NI )
+    case AES_BACKEND_AESNI:
+        if( !aes_ni_supported( ) )
+            break;
+        aes_ops = &aes_aesni_ops;
+        return 0;
+#endif
+#if defined( USE_BITSLICE )
+    case AES_BACKEND_BITSLICE:
+        if( !aes_sse2_supported( ) )
+            break;
+        aes_ops = &aes_bitslice_ops;
+        return 0;
+#endif
+    default:
+        break;
+    }
+    return ( uint8_t )-1;
+}
+
+aes_backend aes_get_backend( void )
+{
+    if( aes_ops == NULL )
+        aes_select_backend( );
+    return aes_ops->id;
+}
+
+/*  Encrypt a single block of 16 bytes */
+
+return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    if( aes_ops == NULL )
+        aes_select_backend( );
+    return aes_ops->encrypt( in, out, ctx );
+}
+
+/*  Encrypt a number of independent blocks (ECB) */
+
+return_type aes_encrypt_blocks( const uint8_t *in, uint8_t *out,
+                         int32_t n_block, const aes_context ctx[1] )
+{
+    if( aes_ops == NULL )
+        aes_select_backend( );
+    return aes_ops->encrypt_blocks( in, out, n_block, ctx );
+}
+
+/*  Encrypt a number of blocks in place, block[i] under ctx[i] */
+
+return_type aes_encrypt_multikey( uint8_t *block[], const aes_context *ctx[],
+                         int32_t n_block )
+{
+    if( aes_ops == NULL )
+        aes_select_backend( );
+    return aes_ops->encrypt_multikey( block, ctx, n_block );
+}
+
+/*  Number of blocks the multi-key kernel of the backend keeps in flight */
+
+uint8_t aes_multikey_lanes( void )
+{
+    if( aes_ops == NULL )
+        aes_select_backend( );
+    return aes_ops->multikey_lanes;
+}
+
+/*  Increment the big endian counter held in the last four bytes of a block */
+
+static void ctr_increment( uint8_t ctr[N_BLOCK] )
+{   uint8_t i = N_BLOCK;
+
+    while( i > N_BLOCK - 4 && ++ctr[--i] == 0 )
+        ;
+}
+
+/* CTR keystream for a number of blocks (input and return a counter block) */
+
+return_type aes_ctr_keystream( uint8_t counter_block[N_BLOCK], int32_t n_block,
+                         uint8_t *out, const aes_context ctx[1] )
+{   uint8_t *p = out;
+    int32_t n;
+
+    for( n = n_block ; n > 0 ; --n )
+    {
+        block_copy(p, counter_block);
+        ctr_increment(counter_block);
+        p += N_BLOCK;
+    }
+    return aes_encrypt_blocks( out, out, n_block, ctx );
+}
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type aes_cbc_encrypt( const uint8_t *in, uint8_t *out,
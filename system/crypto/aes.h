@@ -26,6 +26,10 @@
 
  This is an AES implementation that uses only 8-bit byte operations on the
  cipher state.
+
+ Encryption is dispatched to one of several backends (byte oriented rounds,
+ 32-bit T-tables, AES-NI or bitsliced SSE2) depending on the build and the
+ host CPU.
  */
 
 #ifndef AES_H
@@ -50,6 +54,17 @@
 #  define AES_DEC_256_OTFK  /* AES decryption with 'on the fly' 256 bit keying */
 #endif
 
+/*  Table profiles, trading flash for speed. Define AES_TABLE_PROFILE to
+    one of these to override the default (AES_TABLES_FAST on x86 hosts,
+    AES_TABLES_BALANCED otherwise). All tables are generated at compile
+    time and live in flash.
+*/
+
+#define AES_TABLES_NONE         0   /* no tables, S box computed per byte  */
+#define AES_TABLES_MINIMAL      1   /* S box only, 2.S and 3.S computed    */
+#define AES_TABLES_BALANCED     2   /* S box, 2.S and 3.S tables           */
+#define AES_TABLES_FAST         3   /* balanced plus 32-bit T-tables       */
+
 #define N_ROW                   4
 #define N_COL                   4
 #define N_BLOCK   (N_ROW * N_COL)
@@ -76,6 +91,21 @@ typedef struct
     128, 192, 16, 24 and 32).
 */
 
+/*  Memory cost of the table profile compiled in: flash holds the constant
+    tables, ram is the writable memory they need (none, as the tables are
+    built by the compiler) plus the size of one key schedule.
+*/
+
+typedef struct
+{
+    uint8_t  profile;       /* AES_TABLES_xxx                              */
+    uint32_t flash;         /* bytes of constant tables                    */
+    uint32_t ram;           /* bytes of writable table memory              */
+    uint32_t context;       /* bytes of one aes_context                    */
+} aes_footprint;
+
+void aes_get_footprint( aes_footprint *fp );
+
 #if defined( AES_ENC_PREKEYED ) || defined( AES_DEC_PREKEYED )
 
 return_type aes_set_key( const uint8_t key[],
@@ -85,6 +115,32 @@ return_type aes_set_key( const uint8_t key[],
 
 #if defined( AES_ENC_PREKEYED )
 
+/*  Encryption backends. The fastest backend compiled in and supported by
+    the CPU is selected on first use; aes_set_backend() returns a non zero
+    value if the requested backend is not available.
+
+    The bitsliced backend is never picked automatically: it has no key or
+    data dependent memory accesses, but a single block costs as much as a
+    batch of eight, so it pays off only through aes_encrypt_blocks(),
+    aes_encrypt_multikey() and AES_CMAC_Batch(). While it is selected
+    aes_set_key() uses its S box too; a key set before selecting it was
+    expanded with the table lookups of the default profile.
+*/
+
+typedef enum
+{
+    AES_BACKEND_BYTE = 0,   /* byte oriented rounds (smallest footprint)   */
+    AES_BACKEND_TTABLE,     /* 32-bit T-table rounds                       */
+    AES_BACKEND_AESNI,      /* x86 AES-NI instructions                     */
+    AES_BACKEND_BITSLICE    /* constant time bitsliced SSE2, 8 blocks/pass */
+} aes_backend;
+
+return_type aes_set_backend( aes_backend backend );
+
+aes_backend aes_get_backend( void );
+
+/*  in and out may be the same block with every backend */
+
 return_type aes_encrypt( const uint8_t in[N_BLOCK],
                          uint8_t out[N_BLOCK],
                          const aes_context ctx[1] );
@@ -94,6 +150,42 @@ return_type aes_cbc_encrypt( const uint8_t *in,
                          int32_t n_block,
                          uint8_t iv[N_BLOCK],
                          const aes_context ctx[1] );
+
+/*  Encrypt n_block independent 16 byte blocks. The blocks are interleaved
+    in the backend so several are in flight at once; in and out may be the
+    same buffer.
+*/
+
+return_type aes_encrypt_blocks( const uint8_t *in,
+                         uint8_t *out,
+                         int32_t n_block,
+                         const aes_context ctx[1] );
+
+/*  Encrypt n_block blocks in place, block[i] under the key schedule ctx[i].
+    This runs several independent computations (e.g. CMACs under different
+    keys) side by side through the backend pipelines.
+*/
+
+return_type aes_encrypt_multikey( uint8_t *block[],
+                         const aes_context *ctx[],
+                         int32_t n_block );
+
+/*  Number of blocks the active backend encrypts side by side in
+    aes_encrypt_multikey(); 1 when it is a plain loop of aes_encrypt()
+*/
+
+uint8_t aes_multikey_lanes( void );
+
+/*  Generate n_block blocks of CTR keystream into out. The last four bytes
+    of counter_block are a big endian block counter, incremented once per
+    block (for the LoRaWAN A_i blocks this is the index i); the updated
+    counter block is returned so that keystream can be continued.
+*/
+
+return_type aes_ctr_keystream( uint8_t counter_block[N_BLOCK],
+                         int32_t n_block,
+                         uint8_t *out,
+                         const aes_context ctx[1] );
 #endif
 
 #if defined( AES_DEC_PREKEYED )
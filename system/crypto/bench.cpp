@@ -0,0 +1,502 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host microbenchmark of the AES / CMAC primitives at LoRaWAN
+             frame sizes
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+
+Only compiled when CRYPTO_BENCHMARK is defined, so the firmware build skips
+it. Host build, from the repository root:
+
+    g++ -O2 -DCRYPTO_BENCHMARK -Isystem -Isystem/crypto \
+        system/crypto/bench.cpp system/crypto/aes.cpp \
+        system/crypto/cmac.cpp system/crypto/session.cpp -o crypto_bench
+
+    ./crypto_bench [--json] [--samples N] [--backend N]
+
+Every primitive is measured on every AES backend available on the host (or
+only on --backend N) at 1, 16, 23, 51 and 64 byte payloads. Each sample
+times a batch of calls long enough to dwarf the clock resolution. The
+report gives the min / median / p99 of the per call time and the median
+cycles per payload byte (from the time stamp counter on x86, otherwise
+not reported). The "(loop)" rows do the work of the row below them with
+one aes_encrypt call per block, as the speedup baseline. AES_CMAC_UpdateV
+MICs the B0 block and the payload in place, AES_CMAC(gather) the same
+after copying both into one buffer.
+
+The MIC rows also report MICs per second on the one core the bench runs
+on; AES_CMAC(serial) computes the same BENCH_JOBS MICs, each under its own
+key, as AES_CMAC_Batch.
+*/
+#if defined( CRYPTO_BENCHMARK )
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "aes.h"
+#include "cmac.h"
+#include "session.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES                           1
+#else
+#define BENCH_HAVE_CYCLES                           0
+#endif
+
+/*!
+ * Default number of samples per measurement
+ */
+#define BENCH_SAMPLES                               201
+
+/*!
+ * Minimum duration of one sample [ns]
+ */
+#define BENCH_SAMPLE_MIN_NS                         20000
+
+/*!
+ * Largest payload measured (LORAWAN_APP_DATA_MAX_SIZE)
+ */
+#define BENCH_MAX_SIZE                              64
+
+/*
+ * Number of keys, and MICs, of the batch rows
+ */
+#define BENCH_JOBS                                  16
+
+static const uint16_t BenchSizes[] = { 1, 16, 23, 51, BENCH_MAX_SIZE };
+
+static const char *BackendNames[] = { "byte", "ttable", "aesni", "bitslice" };
+
+/*!
+ * Benchmark state shared by the primitives
+ */
+static struct
+{
+    uint8_t Key[16];
+    uint8_t In[BENCH_MAX_SIZE + N_BLOCK];
+    uint8_t Out[BENCH_MAX_SIZE + N_BLOCK];
+    uint8_t Iv[N_BLOCK];
+    uint8_t B0[N_BLOCK];
+    uint8_t Gather[N_BLOCK + BENCH_MAX_SIZE];
+    aes_context Aes;
+    AES_CMAC_CTX Cmac;
+    AES_CMAC_CTX JobCmac[BENCH_JOBS];
+    AES_CMAC_JOB Jobs[BENCH_JOBS];
+    uint8_t Digests[BENCH_JOBS][AES_CMAC_DIGEST_LENGTH];
+    CryptoSession_t Session;
+    uint32_t Sink;
+}Bench;
+
+/*!
+ * Host stand ins for the board helpers used by cmac.cpp and session.cpp
+ */
+void memcpy1( uint8_t *dst, const uint8_t *src, uint16_t size )
+{
+    memcpy( dst, src, size );
+}
+
+void memset1( uint8_t *dst, uint8_t value, uint16_t size )
+{
+    memset( dst, value, size );
+}
+
+static uint64_t NowNs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t NowCycles( void )
+{
+#if( BENCH_HAVE_CYCLES == 1 )
+    return __rdtsc( );
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Primitives. Each performs one call on a payload of size bytes.
+ */
+static void BenchSetKey( uint16_t size )
+{
+    ( void )size;
+    aes_set_key( Bench.Key, 16, &Bench.Aes );
+}
+
+static void BenchEncrypt( uint16_t size )
+{
+    ( void )size;
+    aes_encrypt( Bench.In, Bench.Out, &Bench.Aes );
+}
+
+static void BenchEncryptLoop( uint16_t size )
+{
+    int32_t n = ( size + N_BLOCK - 1 ) / N_BLOCK;
+    int32_t i;
+
+    for( i = 0; i < n; i++ )
+    {
+        aes_encrypt( Bench.In + i * N_BLOCK, Bench.Out + i * N_BLOCK, &Bench.Aes );
+    }
+}
+
+static void BenchEncryptBlocks( uint16_t size )
+{
+    aes_encrypt_blocks( Bench.In, Bench.Out, ( size + N_BLOCK - 1 ) / N_BLOCK, &Bench.Aes );
+}
+
+static void BenchCbcEncrypt( uint16_t size )
+{
+    aes_cbc_encrypt( Bench.In, Bench.Out, ( size + N_BLOCK - 1 ) / N_BLOCK, Bench.Iv, &Bench.Aes );
+}
+
+static void BenchCtrLoop( uint16_t size )
+{
+    uint8_t ctr[N_BLOCK] = { 0x01 };
+    int32_t n = ( size + N_BLOCK - 1 ) / N_BLOCK;
+    int32_t i;
+
+    for( i = 0; i < n; i++ )
+    {
+        ctr[N_BLOCK - 1] = ( uint8_t )( i + 1 );
+        aes_encrypt( ctr, Bench.Out + i * N_BLOCK, &Bench.Aes );
+    }
+}
+
+static void BenchCtrKeystream( uint16_t size )
+{
+    uint8_t ctr[N_BLOCK] = { 0x01 };
+
+    aes_ctr_keystream( ctr, ( size + N_BLOCK - 1 ) / N_BLOCK, Bench.Out, &Bench.Aes );
+}
+
+static void BenchCmacKeyed( uint16_t size )
+{
+    AES_CMAC_Init( &Bench.Cmac );
+    AES_CMAC_SetKey( &Bench.Cmac, Bench.Key );
+    AES_CMAC_Update( &Bench.Cmac, Bench.In, size );
+    AES_CMAC_Final( Bench.Out, &Bench.Cmac );
+}
+
+static void BenchCmacReset( uint16_t size )
+{
+    AES_CMAC_Reset( &Bench.Cmac );
+    AES_CMAC_Update( &Bench.Cmac, Bench.In, size );
+    AES_CMAC_Final( Bench.Out, &Bench.Cmac );
+}
+
+static void BenchCmacGather( uint16_t size )
+{
+    memcpy( Bench.Gather, Bench.B0, N_BLOCK );
+    memcpy( Bench.Gather + N_BLOCK, Bench.In, size );
+    AES_CMAC_Reset( &Bench.Cmac );
+    AES_CMAC_Update( &Bench.Cmac, Bench.Gather, N_BLOCK + size );
+    AES_CMAC_Final( Bench.Out, &Bench.Cmac );
+}
+
+static void BenchCmacUpdateV( uint16_t size )
+{
+    AES_CMAC_IOVEC iov[2] = { { Bench.B0, N_BLOCK }, { Bench.In, size } };
+
+    AES_CMAC_Reset( &Bench.Cmac );
+    AES_CMAC_UpdateV( &Bench.Cmac, iov, 2 );
+    AES_CMAC_Final( Bench.Out, &Bench.Cmac );
+}
+
+static void BenchCmacSerial( uint16_t size )
+{
+    uint8_t i;
+
+    for( i = 0; i < BENCH_JOBS; i++ )
+    {
+        AES_CMAC_Reset( &Bench.JobCmac[i] );
+        AES_CMAC_Update( &Bench.JobCmac[i], Bench.In, size );
+        AES_CMAC_Final( Bench.Digests[i], &Bench.JobCmac[i] );
+    }
+}
+
+static void BenchCmacBatch( uint16_t size )
+{
+    uint8_t i;
+
+    for( i = 0; i < BENCH_JOBS; i++ )
+    {
+        Bench.Jobs[i].len = size;
+    }
+    AES_CMAC_Batch( Bench.Jobs, BENCH_JOBS );
+}
+
+static void BenchSessionMic( uint16_t size )
+{
+    uint32_t mic;
+
+    CryptoSessionComputeMic( &Bench.Session, Bench.In, size, 0, Bench.Sink, &mic );
+    Bench.Sink += mic;
+}
+
+static void BenchSessionEncrypt( uint16_t size )
+{
+    CryptoSessionPayloadEncrypt( &Bench.Session, Bench.In, size, 1, 0, Bench.Sink, Bench.Out );
+    Bench.Sink += Bench.Out[0];
+}
+
+typedef struct
+{
+    const char *Name;
+    void ( *Run )( uint16_t size );
+    bool Sized;     // false: the call does not depend on the payload size
+    uint8_t Mics;   // MICs computed per call, 0 for the other primitives
+}BenchPrimitive_t;
+
+static const BenchPrimitive_t Primitives[] =
+{
+    { "aes_set_key",               BenchSetKey,         false, 0 },
+    { "aes_encrypt",               BenchEncrypt,        false, 0 },
+    { "aes_encrypt(loop)",         BenchEncryptLoop,    true,  0 },
+    { "aes_encrypt_blocks",        BenchEncryptBlocks,  true,  0 },
+    { "aes_cbc_encrypt",           BenchCbcEncrypt,     true,  0 },
+    { "aes_ctr_keystream(loop)",   BenchCtrLoop,        true,  0 },
+    { "aes_ctr_keystream",         BenchCtrKeystream,   true,  0 },
+    { "AES_CMAC(SetKey+Final)",    BenchCmacKeyed,      true,  1 },
+    { "AES_CMAC(Reset+Final)",     BenchCmacReset,      true,  1 },
+    { "AES_CMAC(gather)",          BenchCmacGather,     true,  1 },
+    { "AES_CMAC_UpdateV",          BenchCmacUpdateV,    true,  1 },
+    { "AES_CMAC(serial)",          BenchCmacSerial,     true,  BENCH_JOBS },
+    { "AES_CMAC_Batch",            BenchCmacBatch,      true,  BENCH_JOBS },
+    { "CryptoSessionComputeMic",   BenchSessionMic,     true,  1 },
+    { "CryptoSessionPayloadEncrypt", BenchSessionEncrypt, true, 0 },
+};
+
+typedef struct
+{
+    double MinNs;
+    double MedianNs;
+    double P99Ns;
+    double CyclesPerByte;
+    double MicsPerSecond;
+}BenchResult_t;
+
+static int CompareDouble( const void *a, const void *b )
+{
+    double x = *( const double* )a;
+    double y = *( const double* )b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*!
+ * \brief Measures one primitive at one payload size
+ */
+static void BenchMeasure( const BenchPrimitive_t *prim, uint16_t size, uint32_t samples, double *ns, double *cycles, BenchResult_t *result )
+{
+    uint32_t batch = 1;
+    uint32_t i, s;
+    uint32_t bytes = prim->Sized ? size : N_BLOCK;
+
+    if( prim->Mics > 1 )
+    {
+        bytes *= prim->Mics;
+    }
+
+    // Calibrate the batch so that one sample lasts at least BENCH_SAMPLE_MIN_NS
+    for( ;; )
+    {
+        uint64_t t0 = NowNs( );
+
+        for( i = 0; i < batch; i++ )
+        {
+            prim->Run( size );
+        }
+        if( ( NowNs( ) - t0 ) >= BENCH_SAMPLE_MIN_NS || batch >= ( 1u << 24 ) )
+        {
+            break;
+        }
+        batch *= 2;
+    }
+
+    for( s = 0; s < samples; s++ )
+    {
+        uint64_t t0 = NowNs( );
+        uint64_t c0 = NowCycles( );
+
+        for( i = 0; i < batch; i++ )
+        {
+            prim->Run( size );
+        }
+        cycles[s] = ( double )( NowCycles( ) - c0 ) / batch;
+        ns[s] = ( double )( NowNs( ) - t0 ) / batch;
+    }
+    qsort( ns, samples, sizeof( double ), CompareDouble );
+    qsort( cycles, samples, sizeof( double ), CompareDouble );
+
+    result->MinNs = ns[0];
+    result->MedianNs = ns[samples / 2];
+    result->P99Ns = ns[( samples * 99 ) / 100];
+    result->CyclesPerByte = BENCH_HAVE_CYCLES ? cycles[samples / 2] / bytes : 0.0;
+    result->MicsPerSecond = prim->Mics * 1e9 / result->MedianNs;
+}
+
+static void Usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [--json] [--samples N] [--backend N]\n", name );
+}
+
+int main( int argc, char **argv )
+{
+    bool json = false;
+    bool first = true;
+    uint32_t samples = BENCH_SAMPLES;
+    int only = -1;
+    double *ns, *cycles;
+    uint8_t key[16];
+    int backend, i;
+    size_t p, z;
+
+    for( i = 1; i < argc; i++ )
+    {
+        if( strcmp( argv[i], "--json" ) == 0 )
+        {
+            json = true;
+        }
+        else if( ( strcmp( argv[i], "--samples" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            samples = strtoul( argv[++i], NULL, 0 );
+        }
+        else if( ( strcmp( argv[i], "--backend" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            only = atoi( argv[++i] );
+        }
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+    if( samples == 0 )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    ns = ( double* )malloc( samples * sizeof( double ) );
+    cycles = ( double* )malloc( samples * sizeof( double ) );
+    if( ( ns == NULL ) || ( cycles == NULL ) )
+    {
+        return EXIT_FAILURE;
+    }
+
+    for( z = 0; z < sizeof( Bench.In ); z++ )
+    {
+        Bench.In[z] = ( uint8_t )( z * 7 + 1 );
+    }
+    for( z = 0; z < sizeof( Bench.B0 ); z++ )
+    {
+        Bench.B0[z] = ( uint8_t )( z * 3 + 0x49 );
+    }
+    for( z = 0; z < sizeof( Bench.Key ); z++ )
+    {
+        Bench.Key[z] = ( uint8_t )( z * 13 + 5 );
+    }
+    aes_set_key( Bench.Key, 16, &Bench.Aes );
+    AES_CMAC_Init( &Bench.Cmac );
+    AES_CMAC_SetKey( &Bench.Cmac, Bench.Key );
+    memcpy( key, Bench.Key, sizeof( key ) );
+    for( i = 0; i < BENCH_JOBS; i++ )
+    {
+        key[0] = ( uint8_t )i;
+        AES_CMAC_Init( &Bench.JobCmac[i] );
+        AES_CMAC_SetKey( &Bench.JobCmac[i], key );
+        Bench.Jobs[i].ctx = &Bench.JobCmac[i];
+        Bench.Jobs[i].data = Bench.In;
+        Bench.Jobs[i].digest = Bench.Digests[i];
+    }
+    CryptoSessionInit( &Bench.Session, Bench.Key, Bench.Key, 0x26011234 );
+
+    if( json == true )
+    {
+        printf( "[\n" );
+    }
+    else
+    {
+        printf( "%-9s %-30s %5s %10s %10s %10s %10s %10s\n", "backend", "primitive", "bytes",
+                "min ns", "median ns", "p99 ns", "cyc/byte", "MIC/s" );
+    }
+
+    for( backend = AES_BACKEND_BYTE; backend <= AES_BACKEND_BITSLICE; backend++ )
+    {
+        if( ( only >= 0 ) && ( backend != only ) )
+        {
+            continue;
+        }
+        if( aes_set_backend( ( aes_backend )backend ) != 0 )
+        {
+            continue;
+        }
+        for( p = 0; p < sizeof( Primitives ) / sizeof( Primitives[0] ); p++ )
+        {
+            for( z = 0; z < sizeof( BenchSizes ) / sizeof( BenchSizes[0] ); z++ )
+            {
+                BenchResult_t r;
+                uint16_t size = BenchSizes[z];
+
+                if( ( Primitives[p].Sized == false ) && ( z > 0 ) )
+                {
+                    break;
+                }
+                BenchMeasure( &Primitives[p], size, samples, ns, cycles, &r );
+                if( Primitives[p].Sized == false )
+                {
+                    size = N_BLOCK;
+                }
+
+                if( json == true )
+                {
+                    printf( "%s  {\"backend\": \"%s\", \"primitive\": \"%s\", \"bytes\": %u, "
+                            "\"min_ns\": %.1f, \"median_ns\": %.1f, \"p99_ns\": %.1f, \"cycles_per_byte\": %.2f, "
+                            "\"mics_per_s\": %.0f}",
+                            first ? "" : ",\n", BackendNames[backend], Primitives[p].Name, size,
+                            r.MinNs, r.MedianNs, r.P99Ns, r.CyclesPerByte, r.MicsPerSecond );
+                    first = false;
+                }
+                else
+                {
+                    printf( "%-9s %-30s %5u %10.1f %10.1f %10.1f %10.2f", BackendNames[backend],
+                            Primitives[p].Name, size, r.MinNs, r.MedianNs, r.P99Ns, r.CyclesPerByte );
+                    if( Primitives[p].Mics > 0 )
+                    {
+                        printf( " %10.0f\n", r.MicsPerSecond );
+                    }
+                    else
+                    {
+                        printf( " %10s\n", "-" );
+                    }
+                }
+                fflush( stdout );
+            }
+        }
+    }
+    if( json == true )
+    {
+        printf( "\n]\n" );
+    }
+
+    free( ns );
+    free( cycles );
+    return EXIT_SUCCESS;
+}
+
+#endif // CRYPTO_BENCHMARK
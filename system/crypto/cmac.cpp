@@ -35,6 +35,7 @@ DEALINGS WITH THE SOFTWARE
 //#include <sys/param.h>
 //#include <sys/systm.h> 
 #include <stdint.h>
+#include <string.h>
 #include "aes.h"
 #include "cmac.h"
 #include "utilities.h"
@@ -46,32 +47,67 @@ DEALINGS WITH THE SOFTWARE
             (r)[15] = (v)[15] << 1;                                 \
     } while (0)
     
-#define XOR(v, r) do {                                          \
-            int32_t i;                                                  \
-            for (i = 0; i < 16; i++)     \
-        {   \
-                    (r)[i] = (r)[i] ^ (v)[i]; \
-        }                          \
-    } while (0) \
+#define XOR(v, r) xor_block((r), (v))
 
+/* multiplication by x in GF(2^128), as used to derive the subkeys */
+#define SUBKEY(v, r) do {                                       \
+            if ((v)[0] & 0x80) {                                \
+                    LSHIFT(v, r);                               \
+                    (r)[15] ^= 0x87;                            \
+            } else                                              \
+                    LSHIFT(v, r);                               \
+    } while (0)
+
+/*
+ * XOR of a 16 byte block, 64 bits at a time. The message data may have any
+ * alignment; the fixed size memcpy calls are inlined into plain loads and
+ * stores by the compiler.
+ */
+static void xor_block(uint8_t r[16], const uint8_t v[16])
+{
+            uint64_t a, b;
+
+            memcpy(&a, r, 8);
+            memcpy(&b, v, 8);
+            a ^= b;
+            memcpy(r, &a, 8);
+
+            memcpy(&a, r + 8, 8);
+            memcpy(&b, v + 8, 8);
+            a ^= b;
+            memcpy(r + 8, &a, 8);
+}
 
 void AES_CMAC_Init(AES_CMAC_CTX *ctx)
 {
             memset1(ctx->X, 0, sizeof ctx->X);
             ctx->M_n = 0;
         memset1(ctx->rijndael.ksch, '\0', 240);
+        memset1(ctx->K1, 0, sizeof ctx->K1);
+        memset1(ctx->K2, 0, sizeof ctx->K2);
 }
     
 void AES_CMAC_SetKey(AES_CMAC_CTX *ctx, const uint8_t key[AES_CMAC_KEY_LENGTH])
 {
            //rijndael_set_key_enc_only(&ctx->rijndael, key, 128);
        aes_set_key( key, AES_CMAC_KEY_LENGTH, &ctx->rijndael);
+
+       /* generate subkeys K1 and K2 once per key */
+       memset1(ctx->K1, '\0', 16);
+       aes_encrypt( ctx->K1, ctx->K1, &ctx->rijndael);
+       SUBKEY(ctx->K1, ctx->K1);
+       SUBKEY(ctx->K1, ctx->K2);
+}
+
+void AES_CMAC_Reset(AES_CMAC_CTX *ctx)
+{
+            memset1(ctx->X, 0, sizeof ctx->X);
+            ctx->M_n = 0;
 }
     
 void AES_CMAC_Update(AES_CMAC_CTX *ctx, const uint8_t *data, uint32_t len)
 {
             uint32_t mlen;
-        uint8_t in[16];
     
             if (ctx->M_n > 0) {
                   mlen = MIN(16 - ctx->M_n, len);
@@ -88,11 +124,7 @@ void AES_CMAC_Update(AES_CMAC_CTX *ctx, const uint8_t *data, uint32_t len)
             while (len > 16) {      /* not last block */
 
                     XOR(data, ctx->X);
-                    //rijndael_encrypt(&ctx->rijndael, ctx->X, ctx->X);
-
-                    memcpy1(in, &ctx->X[0], 16); //Bestela ez du ondo iten
-            aes_encrypt( in, in, &ctx->rijndael);
-                    memcpy1(&ctx->X[0], in, 16);
+                    aes_encrypt( ctx->X, ctx->X, &ctx->rijndael);
 
                     data += 16;
                     len -= 16;
@@ -101,53 +133,133 @@ void AES_CMAC_Update(AES_CMAC_CTX *ctx, const uint8_t *data, uint32_t len)
             memcpy1(ctx->M_last, data, len);
             ctx->M_n = len;
 }
+
+void AES_CMAC_UpdateV(AES_CMAC_CTX *ctx, const AES_CMAC_IOVEC *iov, uint32_t count)
+{
+            /* partial blocks are carried across segments in M_last/M_n */
+            while (count--) {
+                    AES_CMAC_Update(ctx, iov->data, iov->len);
+                    iov++;
+            }
+}
    
 void AES_CMAC_Final(uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX *ctx)
 {
-            uint8_t K[16];
-        uint8_t in[16];
-            /* generate subkey K1 */
-            memset1(K, '\0', 16);
-
-            //rijndael_encrypt(&ctx->rijndael, K, K);
-
-            aes_encrypt( K, K, &ctx->rijndael);
-
-            if (K[0] & 0x80) {
-                    LSHIFT(K, K);
-                   K[15] ^= 0x87;
-            } else
-                    LSHIFT(K, K);
-
-
             if (ctx->M_n == 16) {
                     /* last block was a complete block */
-                    XOR(K, ctx->M_last);
+                    XOR(ctx->K1, ctx->M_last);
 
            } else {
-                   /* generate subkey K2 */
-                  if (K[0] & 0x80) {
-                          LSHIFT(K, K);
-                          K[15] ^= 0x87;
-                  } else
-                           LSHIFT(K, K);
-
                    /* padding(M_last) */
                    ctx->M_last[ctx->M_n] = 0x80;
                    while (++ctx->M_n < 16)
                          ctx->M_last[ctx->M_n] = 0;
    
-                  XOR(K, ctx->M_last);
+                  XOR(ctx->K2, ctx->M_last);
 
 
            }
            XOR(ctx->M_last, ctx->X);
 
            //rijndael_encrypt(&ctx->rijndael, ctx->X, digest);
+           aes_encrypt(ctx->X, digest, &ctx->rijndael);
+
+}
+
 
-       memcpy1(in, &ctx->X[0], 16); //Bestela ez du ondo iten
-       aes_encrypt(in, digest, &ctx->rijndael);
-           memset1(K, 0, sizeof K);
+/*
+ * Folds the last (complete or padded) block of a batch job into X
+ */
+static void batch_last_block(const AES_CMAC_JOB *job, uint32_t off, uint8_t X[16])
+{
+            uint8_t M[16];
+            uint32_t n = job->len - off;
 
+            memcpy1(M, job->data + off, n);
+            if (n == 16) {
+                    XOR(job->ctx->K1, M);
+            } else {
+                    M[n] = 0x80;
+                    memset1(M + n + 1, 0, 15 - n);
+                    XOR(job->ctx->K2, M);
+            }
+            XOR(M, X);
 }
 
+/*
+ * One batch job at a time, the same steps as Reset/Update/Final on a local
+ * chaining value since the job context is shared and read only
+ */
+static void batch_serial(const AES_CMAC_JOB *job)
+{
+            uint32_t X[4];                          /* word aligned chaining value */
+            uint32_t off = 0;
+
+            memset1((uint8_t *)X, 0, 16);
+            while (off + 16 < job->len) {
+                    XOR(job->data + off, (uint8_t *)X);
+                    aes_encrypt((uint8_t *)X, (uint8_t *)X, &job->ctx->rijndael);
+                    off += 16;
+            }
+            batch_last_block(job, off, (uint8_t *)X);
+            aes_encrypt((uint8_t *)X, job->digest, &job->ctx->rijndael);
+}
+
+void AES_CMAC_Batch(AES_CMAC_JOB *jobs, uint32_t count)
+{
+            uint32_t X[AES_CMAC_BATCH_LANES][4];    /* word aligned chaining values */
+            const AES_CMAC_JOB *job[AES_CMAC_BATCH_LANES];
+            uint32_t blk[AES_CMAC_BATCH_LANES];
+            uint8_t *in[AES_CMAC_BATCH_LANES];
+            const aes_context *key[AES_CMAC_BATCH_LANES];
+            uint32_t next = 0, i, n, nblk;
+
+            /* the lane bookkeeping only pays off with a multi-lane kernel */
+            if (aes_multikey_lanes() < 2) {
+                    for (i = 0; i < count; i++)
+                            batch_serial(&jobs[i]);
+                    return;
+            }
+
+            for (i = 0; i < AES_CMAC_BATCH_LANES; i++)
+                    job[i] = NULL;
+
+            for (;;) {
+                    /* give idle lanes the next jobs */
+                    for (i = 0; i < AES_CMAC_BATCH_LANES && next < count; i++) {
+                            if (job[i] == NULL) {
+                                    job[i] = &jobs[next++];
+                                    blk[i] = 0;
+                                    memset1((uint8_t *)X[i], 0, 16);
+                            }
+                    }
+
+                    /* one block of every running job, then a single
+                       multi-key encryption of all the chaining values */
+                    for (i = 0, n = 0; i < AES_CMAC_BATCH_LANES; i++) {
+                            if (job[i] == NULL)
+                                    continue;
+                            nblk = (job[i]->len + 15) / 16;
+                            if (blk[i] + 1 < nblk)
+                                    XOR(job[i]->data + 16 * blk[i], (uint8_t *)X[i]);
+                            else
+                                    batch_last_block(job[i], 16 * blk[i], (uint8_t *)X[i]);
+                            in[n] = (uint8_t *)X[i];
+                            key[n] = &job[i]->ctx->rijndael;
+                            n++;
+                    }
+                    if (n == 0)
+                            break;
+                    aes_encrypt_multikey(in, key, n);
+
+                    for (i = 0; i < AES_CMAC_BATCH_LANES; i++) {
+                            if (job[i] == NULL)
+                                    continue;
+                            nblk = (job[i]->len + 15) / 16;
+                            if (++blk[i] >= nblk) {
+                                    memcpy1(job[i]->digest, (uint8_t *)X[i], 16);
+                                    job[i] = NULL;
+                            }
+                    }
+            }
+}
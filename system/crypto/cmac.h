@@ -41,22 +41,52 @@ DEALINGS WITH THE SOFTWARE
 #define AES_CMAC_KEY_LENGTH     16
 #define AES_CMAC_DIGEST_LENGTH  16
  
+/* M_n comes first so that the blocks below are word aligned and can be
+   passed to aes_encrypt in place */
 typedef struct _AES_CMAC_CTX {
-            aes_context    rijndael;
+            uint32_t       M_n;
             uint8_t        X[16];
             uint8_t        M_last[16];
-            uint32_t       M_n;
+            uint8_t        K1[16];      /* subkeys, derived by SetKey */
+            uint8_t        K2[16];
+            aes_context    rijndael;
     } AES_CMAC_CTX;
    
+/* One segment of a message passed to AES_CMAC_UpdateV */
+typedef struct _AES_CMAC_IOVEC {
+            const uint8_t  *data;
+            uint32_t       len;
+    } AES_CMAC_IOVEC;
+
+/* One message of a batch passed to AES_CMAC_Batch. The context must have been
+   keyed with AES_CMAC_SetKey; it is only read, so jobs may share a context */
+typedef struct _AES_CMAC_JOB {
+            const AES_CMAC_CTX *ctx;
+            const uint8_t  *data;
+            uint32_t       len;
+            uint8_t        *digest;
+    } AES_CMAC_JOB;
+
+/* Number of messages processed side by side by AES_CMAC_Batch */
+#define AES_CMAC_BATCH_LANES    8
+
 //#include <sys/cdefs.h>
     
 //__BEGIN_DECLS
 void     AES_CMAC_Init(AES_CMAC_CTX * ctx);
 void     AES_CMAC_SetKey(AES_CMAC_CTX * ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]);
+/* Restarts the MAC computation keeping the key schedule and subkeys */
+void     AES_CMAC_Reset(AES_CMAC_CTX * ctx);
 void     AES_CMAC_Update(AES_CMAC_CTX * ctx, const uint8_t * data, uint32_t len);
           //          __attribute__((__bounded__(__string__,2,3)));
+/* Same as calling AES_CMAC_Update on each segment in turn, e.g. the B0 block
+   followed by the frame, without first gathering them in one buffer */
+void     AES_CMAC_UpdateV(AES_CMAC_CTX * ctx, const AES_CMAC_IOVEC * iov, uint32_t count);
 void     AES_CMAC_Final(uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX  * ctx);
             //     __attribute__((__bounded__(__minbytes__,1,AES_CMAC_DIGEST_LENGTH)));
+/* Computes the CMAC of every job, each under its own key. The jobs run one
+   after the other when the AES backend has no multi-lane kernel */
+void     AES_CMAC_Batch(AES_CMAC_JOB * jobs, uint32_t count);
 //__END_DECLS
 
 #endif /* _CMAC_H_ */
@@ -0,0 +1,114 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Per session LoRaWAN frame crypto with cached key schedules
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#include <stdint.h>
+#include "utilities.h"
+#include "session.h"
+
+/*!
+ * Number of keystream blocks generated per aes_ctr_keystream call
+ */
+#define CRYPTO_SESSION_KEYSTREAM_BLOCKS             4
+
+/*!
+ * \brief Writes a 32 bit value little endian
+ */
+static void PutUint32( uint8_t *dst, uint32_t value )
+{
+    dst[0] = value & 0xFF;
+    dst[1] = ( value >> 8 ) & 0xFF;
+    dst[2] = ( value >> 16 ) & 0xFF;
+    dst[3] = ( value >> 24 ) & 0xFF;
+}
+
+void CryptoSessionInit( CryptoSession_t *session, const uint8_t *nwkSKey, const uint8_t *appSKey, uint32_t address )
+{
+    uint8_t dir;
+
+    AES_CMAC_Init( &session->NwkSKeyCmac );
+    AES_CMAC_SetKey( &session->NwkSKeyCmac, nwkSKey );
+
+    memset1( session->AppSKeySchedule.ksch, 0, sizeof( session->AppSKeySchedule.ksch ) );
+    aes_set_key( appSKey, 16, &session->AppSKeySchedule );
+
+    for( dir = CRYPTO_SESSION_UPLINK; dir <= CRYPTO_SESSION_DOWNLINK; dir++ )
+    {
+        // B0 = 0x49 | 0x00 x 4 | Dir | DevAddr | FCnt | 0x00 | len
+        memset1( session->B0[dir], 0, N_BLOCK );
+        session->B0[dir][0] = 0x49;
+        session->B0[dir][5] = dir;
+        PutUint32( &session->B0[dir][6], address );
+
+        // A_i = 0x01 | 0x00 x 4 | Dir | DevAddr | FCnt | 0x00 | i
+        memset1( session->A[dir], 0, N_BLOCK );
+        session->A[dir][0] = 0x01;
+        session->A[dir][5] = dir;
+        PutUint32( &session->A[dir][6], address );
+    }
+}
+
+void CryptoSessionComputeMic( CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t dir, uint32_t sequenceCounter, uint32_t *mic )
+{
+    uint8_t b0[N_BLOCK];
+    uint8_t digest[AES_CMAC_DIGEST_LENGTH];
+    AES_CMAC_IOVEC iov[2];
+
+    memcpy1( b0, session->B0[dir], N_BLOCK );
+    PutUint32( &b0[10], sequenceCounter );
+    b0[15] = size & 0xFF;
+
+    iov[0].data = b0;
+    iov[0].len = N_BLOCK;
+    iov[1].data = buffer;
+    iov[1].len = size;
+
+    AES_CMAC_Reset( &session->NwkSKeyCmac );
+    AES_CMAC_UpdateV( &session->NwkSKeyCmac, iov, 2 );
+    AES_CMAC_Final( digest, &session->NwkSKeyCmac );
+
+    *mic = ( uint32_t )( ( uint32_t )digest[3] << 24 | ( uint32_t )digest[2] << 16 |
+                         ( uint32_t )digest[1] << 8 | ( uint32_t )digest[0] );
+}
+
+void CryptoSessionPayloadEncrypt( const CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t fPort, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer )
+{
+    const aes_context *ctx = ( fPort == 0 ) ? &session->NwkSKeyCmac.rijndael : &session->AppSKeySchedule;
+    uint8_t a[N_BLOCK];
+    uint8_t keystream[CRYPTO_SESSION_KEYSTREAM_BLOCKS * N_BLOCK];
+    uint16_t i;
+
+    memcpy1( a, session->A[dir], N_BLOCK );
+    PutUint32( &a[10], sequenceCounter );
+    a[15] = 1;
+
+    while( size > 0 )
+    {
+        uint16_t len = MIN( size, sizeof( keystream ) );
+
+        // Advances the block index in a[15] past the generated blocks
+        aes_ctr_keystream( a, ( len + N_BLOCK - 1 ) / N_BLOCK, keystream, ctx );
+        for( i = 0; i < len; i++ )
+        {
+            encBuffer[i] = buffer[i] ^ keystream[i];
+        }
+        buffer += len;
+        encBuffer += len;
+        size -= len;
+    }
+}
+
+void CryptoSessionPayloadDecrypt( const CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t fPort, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer )
+{
+    CryptoSessionPayloadEncrypt( session, buffer, size, fPort, dir, sequenceCounter, decBuffer );
+}
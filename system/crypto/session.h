@@ -0,0 +1,105 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Per session LoRaWAN frame crypto with cached key schedules
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+*/
+#ifndef __CRYPTO_SESSION_H__
+#define __CRYPTO_SESSION_H__
+
+#include <stdint.h>
+#include "aes.h"
+#include "cmac.h"
+
+/*!
+ * Frame direction, as used in the B0 and A_i blocks
+ */
+#define CRYPTO_SESSION_UPLINK                       0
+#define CRYPTO_SESSION_DOWNLINK                     1
+
+/*!
+ * \brief Session crypto state, built once when the session keys are known
+ *
+ * \remark Holds the expanded NwkSKey and AppSKey schedules, the CMAC subkeys
+ *         and the B0 / A_i block templates of both directions with DevAddr
+ *         filled in, so that per frame only FCnt and the length (MIC) or the
+ *         block index (encryption) remain to be patched.
+ */
+typedef struct CryptoSession_s
+{
+    /*!
+     * CMAC context keyed with NwkSKey; its key schedule also serves the
+     * encryption of FPort 0 (MAC command) payloads
+     */
+    AES_CMAC_CTX NwkSKeyCmac;
+    /*!
+     * Expanded AppSKey schedule
+     */
+    aes_context AppSKeySchedule;
+    /*!
+     * MIC B0 block templates, indexed by direction
+     */
+    uint8_t B0[2][N_BLOCK];
+    /*!
+     * Payload encryption A_i block templates, indexed by direction
+     */
+    uint8_t A[2][N_BLOCK];
+}CryptoSession_t;
+
+/*!
+ * \brief Expands the session keys and prepares the block templates
+ *
+ * \param [OUT] session Session crypto state
+ * \param [IN]  nwkSKey Network session key
+ * \param [IN]  appSKey Application session key
+ * \param [IN]  address Device address
+ */
+void CryptoSessionInit( CryptoSession_t *session, const uint8_t *nwkSKey, const uint8_t *appSKey, uint32_t address );
+
+/*!
+ * \brief Computes the LoRaMAC frame MIC field
+ *
+ * \param [IN]  session         Session crypto state
+ * \param [IN]  buffer          Data buffer
+ * \param [IN]  size            Data buffer size
+ * \param [IN]  dir             Frame direction [0: uplink, 1: downlink]
+ * \param [IN]  sequenceCounter Frame sequence counter
+ * \param [OUT] mic             Computed MIC field
+ */
+void CryptoSessionComputeMic( CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t dir, uint32_t sequenceCounter, uint32_t *mic );
+
+/*!
+ * \brief Encrypts (or decrypts, the operation is the same) a frame payload
+ *
+ * \param [IN]  session         Session crypto state
+ * \param [IN]  buffer          Data buffer
+ * \param [IN]  size            Data buffer size
+ * \param [IN]  fPort           Frame port; port 0 payloads use NwkSKey, the others AppSKey
+ * \param [IN]  dir             Frame direction [0: uplink, 1: downlink]
+ * \param [IN]  sequenceCounter Frame sequence counter
+ * \param [OUT] encBuffer       Encrypted buffer, may be the same as buffer
+ */
+void CryptoSessionPayloadEncrypt( const CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t fPort, uint8_t dir, uint32_t sequenceCounter, uint8_t *encBuffer );
+
+/*!
+ * \brief Decrypts a frame payload
+ *
+ * \param [IN]  session         Session crypto state
+ * \param [IN]  buffer          Data buffer
+ * \param [IN]  size            Data buffer size
+ * \param [IN]  fPort           Frame port; port 0 payloads use NwkSKey, the others AppSKey
+ * \param [IN]  dir             Frame direction [0: uplink, 1: downlink]
+ * \param [IN]  sequenceCounter Frame sequence counter
+ * \param [OUT] decBuffer       Decrypted buffer, may be the same as buffer
+ */
+void CryptoSessionPayloadDecrypt( const CryptoSession_t *session, const uint8_t *buffer, uint16_t size, uint8_t fPort, uint8_t dir, uint32_t sequenceCounter, uint8_t *decBuffer );
+
+#endif // __CRYPTO_SESSION_H__
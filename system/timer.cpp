@@ -14,65 +14,878 @@ Maintainer: Miguel Luis and Gregory Cristian
 */
 #include "board.h"
 
-Timer TimeCounter;
-Ticker LoadTimeCounter;
+#if defined( TIMER_VIRTUAL_CLOCK )
 
-volatile uint64_t CurrentTime = 0;
+/*!
+ * Virtual time [us], only moved by TimerVirtualClockRunNext and
+ * TimerVirtualClockAdvance
+ */
+static TimerTime_t TimerVirtualTime = 0;
 
-void TimerResetTimeCounter( void )
+void TimerTimeCounterInit( void )
+{
+    TimerVirtualTime = 0;
+}
+
+TimerTime_t TimerGetCurrentTime( void )
+{
+    return TimerVirtualTime;
+}
+
+#else
+
+#include "us_ticker_api.h"
+
+/*!
+ * Longest hardware timeout [us]. Longer timeouts are chained from hops of at
+ * most this length; every hop also refreshes the clock snapshot, so it must
+ * stay well below the 32 bit microsecond counter wrap period (71 minutes).
+ */
+#define TIMER_HW_MAX_HOP                            1800000000
+
+/*!
+ * Snapshot of the 64 bit clock: Time [us] when the 32 bit hardware counter
+ * read Ticks
+ */
+typedef struct TimerClockSnapshot_s
 {
-    CurrentTime = CurrentTime + TimeCounter.read_us( );
-    TimeCounter.reset( );
-    TimeCounter.start( );
+    uint32_t Ticks;
+    TimerTime_t Time;
+}TimerClockSnapshot_t;
+
+/*!
+ * The clock extends the free running hardware counter to 64 bits from a
+ * snapshot. The refresh writes the snapshot readers are not using and then
+ * increments the generation, whose low bit selects the current snapshot. A
+ * reader preempted across two refreshes would see its snapshot rewritten, so
+ * it retries when the generation changed during the read; no lock is needed,
+ * and any snapshot less than one counter period old gives the same time.
+ * The hardware timeout handler is the only writer: the timeout is always
+ * armed, at most TIMER_HW_MAX_HOP after the last refresh, even with no timer
+ * running, which spares a periodic refresh interrupt.
+ */
+static TimerClockSnapshot_t TimerClock[2];
+static volatile uint32_t TimerClockGeneration = 0;
+
+static void TimerSetTimeout( void );
+
+/*!
+ * \brief Refreshes the clock snapshot
+ */
+static void TimerClockUpdate( void )
+{
+    uint32_t generation = TimerClockGeneration;
+    uint32_t ticks = us_ticker_read( );
+    const TimerClockSnapshot_t *current = &TimerClock[generation & 1];
+    TimerClockSnapshot_t *next = &TimerClock[( generation + 1 ) & 1];
+
+    next->Time = current->Time + ( uint32_t )( ticks - current->Ticks );
+    next->Ticks = ticks;
+    __DMB( );
+    TimerClockGeneration = generation + 1;
 }
 
 void TimerTimeCounterInit( void )
 {
-    TimeCounter.start( );
-    LoadTimeCounter.attach( &TimerResetTimeCounter, 10 );
+    TimerClock[0].Ticks = us_ticker_read( );
+    TimerClock[0].Time = 0;
+    TimerClockGeneration = 0;
+    TimerSetTimeout( );
 }
 
 TimerTime_t TimerGetCurrentTime( void )
 {
-    CurrentTime += TimeCounter.read_us( );
-    TimeCounter.reset( );
-    TimeCounter.start( );
-    return ( ( TimerTime_t )CurrentTime );
+    const TimerClockSnapshot_t *snapshot;
+    uint32_t generation;
+    uint32_t ticks;
+    TimerTime_t time;
+    uint32_t now;
+
+    do
+    {
+        generation = TimerClockGeneration;
+        __DMB( );
+        snapshot = &TimerClock[generation & 1];
+        ticks = snapshot->Ticks;
+        time = snapshot->Time;
+        // The hardware counter is read last, so the snapshot is never newer
+        now = us_ticker_read( );
+        __DMB( );
+    }while( generation != TimerClockGeneration );
+
+    return time + ( uint32_t )( now - ticks );
 }
 
+#endif // TIMER_VIRTUAL_CLOCK
+
 TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime )
 {
-    CurrentTime += TimeCounter.read_us( );
-    TimeCounter.reset( );
-    TimeCounter.start( );
-    return ( TimerTime_t )( CurrentTime - savedTime );
+    return TimerGetCurrentTime( ) - savedTime;
 }
 
 TimerTime_t TimerGetFutureTime( TimerTime_t eventInFuture )
 {
-    CurrentTime += TimeCounter.read_us( );
-    TimeCounter.reset( );
-    TimeCounter.start( );
-    return ( TimerTime_t )( CurrentTime + eventInFuture );
+    return TimerGetCurrentTime( ) + eventInFuture;
+}
+
+/*!
+ * \brief Disables the interrupts, returning the previous state
+ */
+static uint32_t TimerEnterCritical( void )
+{
+    uint32_t primask = __get_PRIMASK( );
+
+    __disable_irq( );
+    return primask;
+}
+
+/*!
+ * \brief Restores the interrupt state saved by TimerEnterCritical
+ */
+static void TimerExitCritical( uint32_t primask )
+{
+    __set_PRIMASK( primask );
+}
+
+#if !defined( TIMER_VIRTUAL_CLOCK )
+/*!
+ * Hardware timeout serving the timer queue, armed for the earliest event
+ */
+static Timeout TimerHwTimeout;
+#endif
+
+/*!
+ * Deadline the hardware timeout is armed for, valid while TimerHwArmed. With
+ * the virtual clock, the time the clock must jump to next.
+ */
+static TimerTime_t TimerHwDeadline = 0;
+static bool TimerHwArmed = false;
+
+/*!
+ * Hardware timeout wake ups, and among them those where no timer fired
+ * (chained hops, clock refreshes and wheel cascades)
+ */
+static uint32_t TimerWakeups = 0;
+static uint32_t TimerIntermediateWakeups = 0;
+
+#if defined( TIMER_STATS )
+/*!
+ * Initialized timers, linked through StatsNext, and the handler statistics
+ */
+static TimerEvent_t *TimerStatsList = NULL;
+static uint32_t TimerStatsMaxIsrDuration = 0;
+static uint32_t TimerStatsOverlaps = 0;
+
+/*!
+ * \brief Clears the statistics of a timer and adds it to the list of the
+ *        initialized timers, once
+ */
+static void TimerStatsRegister( TimerEvent_t *obj )
+{
+    uint32_t primask = TimerEnterCritical( );
+    TimerEvent_t *cur = TimerStatsList;
+
+    memset1( ( uint8_t* )&obj->Stats, 0, sizeof( TimerStats_t ) );
+    while( ( cur != NULL ) && ( cur != obj ) )
+    {
+        cur = cur->StatsNext;
+    }
+    if( cur == NULL )
+    {
+        obj->StatsNext = TimerStatsList;
+        TimerStatsList = obj;
+    }
+    TimerExitCritical( primask );
+}
+
+/*!
+ * \brief Accounts one dispatched expiry
+ *
+ * \param [IN] obj      Expired timer
+ * \param [IN] lateness Time from the deadline to the dispatch [us]
+ * \param [IN] overlap  true if dispatched behind another expiry
+ */
+static void TimerStatsRecord( TimerEvent_t *obj, TimerTime_t lateness, bool overlap )
+{
+    uint8_t bin = 0;
+
+    while( ( bin < ( TIMER_STATS_BINS - 1 ) ) && ( lateness >= ( 8u << bin ) ) )
+    {
+        bin++;
+    }
+    obj->Stats.Histogram[bin]++;
+    obj->Stats.Count++;
+    if( lateness > obj->Stats.MaxLateness )
+    {
+        obj->Stats.MaxLateness = ( lateness > UINT32_MAX ) ? UINT32_MAX : ( uint32_t )lateness;
+    }
+    if( overlap == true )
+    {
+        obj->Stats.Overlaps++;
+        TimerStatsOverlaps++;
+    }
+}
+#endif
+
+static void TimerIrqHandler( void );
+
+/*
+ * Timer queue. Both implementations below provide the same five operations,
+ * used by the timer API with the interrupts disabled:
+ *
+ *  - TimerQueueContains:     true while the timer is queued
+ *  - TimerQueueInsert:       queues a timer on its Timestamp
+ *  - TimerQueueRemove:       dequeues a queued timer
+ *  - TimerQueuePopExpired:   dequeues and returns one timer due at now, or NULL
+ *  - TimerQueueNextDeadline: time the hardware timeout must fire at next
+ */
+#if defined( TIMER_USE_WHEEL )
+
+/*!
+ * Wheel tick: 2^TIMER_WHEEL_TICK_SHIFT [us]. The tick only sorts the timers
+ * into slots, every timer still fires at its exact Timestamp.
+ */
+#ifndef TIMER_WHEEL_TICK_SHIFT
+#define TIMER_WHEEL_TICK_SHIFT                      10
+#endif
+
+/*!
+ * Levels of 64 slots; each level spans 64 slots of the level below, 7 levels
+ * cover 2^42 ticks
+ */
+#define TIMER_WHEEL_SLOT_BITS                       6
+#define TIMER_WHEEL_SLOTS                           ( 1 << TIMER_WHEEL_SLOT_BITS )
+#define TIMER_WHEEL_LEVELS                          7
+
+/*!
+ * Hierarchical timing wheel. A timer due at tick E is kept at the level of
+ * the highest 6 bit digit in which E differs from the current tick
+ * TimerWheelTick, in the slot given by that digit of E. When the current tick
+ * reaches the start of a slot of level L > 0, its timers are cascaded to the
+ * levels below. Slots are doubly linked lists and each level keeps a bitmap
+ * of its non empty slots, so start, stop and finding the next slot to serve
+ * are O(1) whatever the number of running timers. So that the timers due
+ * within one tick fire in deadline order, a level 0 slot is merge sorted by
+ * Timestamp once, when it is about to be served, and kept sorted from then
+ * on; TimerWheelSorted flags the slots already sorted.
+ */
+static TimerEvent_t *TimerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t TimerWheelOccupied[TIMER_WHEEL_LEVELS];
+static uint64_t TimerWheelSorted = 0;
+static uint64_t TimerWheelTick = 0;
+static uint32_t TimerWheelCount = 0;
+
+/*!
+ * \brief Returns the index of the lowest bit set in a non zero bitmap
+ */
+static uint8_t TimerWheelLowestSlot( uint64_t bitmap )
+{
+#if defined( __GNUC__ )
+    return __builtin_ctzll( bitmap );
+#else
+    uint8_t slot = 0;
+
+    while( ( bitmap & 1 ) == 0 )
+    {
+        bitmap >>= 1;
+        slot++;
+    }
+    return slot;
+#endif
+}
+
+static bool TimerQueueContains( TimerEvent_t *obj )
+{
+    return obj->Prev != NULL;
+}
+
+static void TimerQueueInsert( TimerEvent_t *obj )
+{
+    uint64_t tick = obj->Timestamp >> TIMER_WHEEL_TICK_SHIFT;
+    uint64_t diff;
+    TimerEvent_t **link;
+    uint8_t level = 0;
+    uint8_t slot;
+
+    if( TimerWheelCount == 0 )
+    {
+        // Nothing to cascade, the wheel can skip the idle time at once
+        TimerWheelTick = TimerGetCurrentTime( ) >> TIMER_WHEEL_TICK_SHIFT;
+    }
+    if( tick < TimerWheelTick )
+    {
+        // Already due, goes to the slot being served
+        tick = TimerWheelTick;
+    }
+
+    diff = tick ^ TimerWheelTick;
+    while( ( diff >= TIMER_WHEEL_SLOTS ) && ( level < ( TIMER_WHEEL_LEVELS - 1 ) ) )
+    {
+        diff >>= TIMER_WHEEL_SLOT_BITS;
+        level++;
+    }
+    slot = ( tick >> ( level * TIMER_WHEEL_SLOT_BITS ) ) & ( TIMER_WHEEL_SLOTS - 1 );
+
+    link = &TimerWheel[level][slot];
+    if( ( level == 0 ) && ( ( TimerWheelSorted & ( 1ull << slot ) ) != 0 ) )
+    {
+        // Ahead of the timers due at the same time, O(1) for a burst of them
+        while( ( *link != NULL ) && ( ( *link )->Timestamp < obj->Timestamp ) )
+        {
+            link = &( *link )->Next;
+        }
+    }
+    obj->Slot = level * TIMER_WHEEL_SLOTS + slot;
+    obj->Next = *link;
+    if( obj->Next != NULL )
+    {
+        obj->Next->Prev = &obj->Next;
+    }
+    obj->Prev = link;
+    *link = obj;
+    TimerWheelOccupied[level] |= 1ull << slot;
+    TimerWheelCount++;
+}
+
+static void TimerQueueRemove( TimerEvent_t *obj )
+{
+    uint8_t level = obj->Slot / TIMER_WHEEL_SLOTS;
+    uint8_t slot = obj->Slot % TIMER_WHEEL_SLOTS;
+
+    *obj->Prev = obj->Next;
+    if( obj->Next != NULL )
+    {
+        obj->Next->Prev = obj->Prev;
+    }
+    if( TimerWheel[level][slot] == NULL )
+    {
+        TimerWheelOccupied[level] &= ~( 1ull << slot );
+        if( level == 0 )
+        {
+            TimerWheelSorted &= ~( 1ull << slot );
+        }
+    }
+    obj->Next = NULL;
+    obj->Prev = NULL;
+    TimerWheelCount--;
+}
+
+/*!
+ * \brief Finds the next slot to serve after the current tick
+ *
+ * \param [OUT] tick Tick at which the slot must be served
+ * \param [OUT] slot Slot index within its level
+ * \retval level Level of the slot, -1 if no timer is due after the current tick
+ */
+static int8_t TimerWheelNextSlot( uint64_t *tick, uint8_t *slot )
+{
+    uint8_t level;
+
+    // A lower level slot is always served before any slot of the levels above
+    for( level = 0; level < TIMER_WHEEL_LEVELS; level++ )
+    {
+        uint8_t shift = level * TIMER_WHEEL_SLOT_BITS;
+        uint8_t current = ( TimerWheelTick >> shift ) & ( TIMER_WHEEL_SLOTS - 1 );
+        uint64_t ahead = ( current == ( TIMER_WHEEL_SLOTS - 1 ) ) ? 0 : TimerWheelOccupied[level] & ( ~0ull << ( current + 1 ) );
+
+        if( ahead != 0 )
+        {
+            *slot = TimerWheelLowestSlot( ahead );
+            *tick = ( ( TimerWheelTick >> ( shift + TIMER_WHEEL_SLOT_BITS ) ) << ( shift + TIMER_WHEEL_SLOT_BITS ) ) |
+                    ( ( uint64_t )*slot << shift );
+            return level;
+        }
+    }
+    return -1;
+}
+
+/*!
+ * \brief Merges two lists sorted by Timestamp, a first on equal Timestamps
+ */
+static TimerEvent_t *TimerWheelMerge( TimerEvent_t *a, TimerEvent_t *b )
+{
+    TimerEvent_t *head = NULL;
+    TimerEvent_t **tail = &head;
+
+    while( ( a != NULL ) && ( b != NULL ) )
+    {
+        if( b->Timestamp < a->Timestamp )
+        {
+            *tail = b;
+            b = b->Next;
+        }
+        else
+        {
+            *tail = a;
+            a = a->Next;
+        }
+        tail = &( *tail )->Next;
+    }
+    *tail = ( a != NULL ) ? a : b;
+    return head;
+}
+
+/*!
+ * \brief Sorts a level 0 slot by Timestamp, unless already sorted
+ *
+ * \remark Bottom up merge sort, runs[i] holds a sorted run of 2^i timers
+ */
+static void TimerWheelSortSlot( uint8_t slot )
+{
+    TimerEvent_t *runs[32] = { NULL };
+    TimerEvent_t *obj = TimerWheel[0][slot];
+    TimerEvent_t *sorted = NULL;
+    TimerEvent_t **prev;
+    uint8_t i;
+
+    if( ( TimerWheelSorted & ( 1ull << slot ) ) != 0 )
+    {
+        return;
+    }
+    while( obj != NULL )
+    {
+        TimerEvent_t *run = obj;
+
+        obj = obj->Next;
+        run->Next = NULL;
+        for( i = 0; runs[i] != NULL; i++ )
+        {
+            run = TimerWheelMerge( runs[i], run );
+            runs[i] = NULL;
+        }
+        runs[i] = run;
+    }
+    for( i = 0; i < 32; i++ )
+    {
+        if( runs[i] != NULL )
+        {
+            sorted = TimerWheelMerge( runs[i], sorted );
+        }
+    }
+
+    TimerWheel[0][slot] = sorted;
+    for( prev = &TimerWheel[0][slot]; *prev != NULL; prev = &( *prev )->Next )
+    {
+        ( *prev )->Prev = prev;
+    }
+    TimerWheelSorted |= 1ull << slot;
+}
+
+static TimerEvent_t *TimerQueuePopExpired( TimerTime_t now )
+{
+    uint64_t target = now >> TIMER_WHEEL_TICK_SHIFT;
+
+    for( ;; )
+    {
+        TimerEvent_t *obj;
+        uint64_t tick;
+        uint8_t slot;
+        int8_t level;
+
+        TimerWheelSortSlot( TimerWheelTick & ( TIMER_WHEEL_SLOTS - 1 ) );
+        obj = TimerWheel[0][TimerWheelTick & ( TIMER_WHEEL_SLOTS - 1 )];
+        // The slot being served may hold timers due later within the tick
+        if( ( obj != NULL ) && ( obj->Timestamp <= now ) )
+        {
+            TimerQueueRemove( obj );
+            return obj;
+        }
+
+        level = TimerWheelNextSlot( &tick, &slot );
+        if( ( level < 0 ) || ( tick > target ) )
+        {
+            if( target > TimerWheelTick )
+            {
+                TimerWheelTick = target;
+            }
+            return NULL;
+        }
+
+        TimerWheelTick = tick;
+        if( level > 0 )
+        {
+            // Cascade the slot to the levels below
+            obj = TimerWheel[level][slot];
+            TimerWheel[level][slot] = NULL;
+            TimerWheelOccupied[level] &= ~( 1ull << slot );
+            while( obj != NULL )
+            {
+                TimerEvent_t *next = obj->Next;
+
+                TimerWheelCount--;
+                TimerQueueInsert( obj );
+                obj = next;
+            }
+        }
+    }
+}
+
+static bool TimerQueueNextDeadline( TimerTime_t *deadline )
+{
+    uint64_t tick;
+    uint8_t slot;
+    int8_t level;
+
+    if( TimerWheelCount == 0 )
+    {
+        return false;
+    }
+    TimerWheelSortSlot( TimerWheelTick & ( TIMER_WHEEL_SLOTS - 1 ) );
+    if( TimerWheel[0][TimerWheelTick & ( TIMER_WHEEL_SLOTS - 1 )] != NULL )
+    {
+        *deadline = TimerWheel[0][TimerWheelTick & ( TIMER_WHEEL_SLOTS - 1 )]->Timestamp;
+        return true;
+    }
+    level = TimerWheelNextSlot( &tick, &slot );
+    if( level == 0 )
+    {
+        TimerWheelSortSlot( slot );
+        *deadline = TimerWheel[0][slot]->Timestamp;
+    }
+    else
+    {
+        // Wake up to cascade the slot
+        *deadline = tick << TIMER_WHEEL_TICK_SHIFT;
+    }
+    return true;
+}
+
+#else
+
+#if ( TIMER_MAX_EVENTS > 127 )
+#error "TIMER_MAX_EVENTS must fit the HeapIndex field"
+#endif
+
+/*!
+ * Running timers, a binary min-heap ordered by Timestamp
+ */
+static TimerEvent_t *TimerHeap[TIMER_MAX_EVENTS];
+static uint8_t TimerHeapSize = 0;
+
+static void TimerHeapSet( uint8_t index, TimerEvent_t *obj )
+{
+    TimerHeap[index] = obj;
+    obj->HeapIndex = index;
+}
+
+static void TimerHeapSiftUp( uint8_t index )
+{
+    TimerEvent_t *obj = TimerHeap[index];
+
+    while( index > 0 )
+    {
+        uint8_t parent = ( index - 1 ) >> 1;
+
+        if( TimerHeap[parent]->Timestamp <= obj->Timestamp )
+        {
+            break;
+        }
+        TimerHeapSet( index, TimerHeap[parent] );
+        index = parent;
+    }
+    TimerHeapSet( index, obj );
+}
+
+static void TimerHeapSiftDown( uint8_t index )
+{
+    TimerEvent_t *obj = TimerHeap[index];
+
+    for( ;; )
+    {
+        uint16_t child = 2 * index + 1;
+
+        if( child >= TimerHeapSize )
+        {
+            break;
+        }
+        if( ( child + 1 < TimerHeapSize ) && ( TimerHeap[child + 1]->Timestamp < TimerHeap[child]->Timestamp ) )
+        {
+            child++;
+        }
+        if( obj->Timestamp <= TimerHeap[child]->Timestamp )
+        {
+            break;
+        }
+        TimerHeapSet( index, TimerHeap[child] );
+        index = child;
+    }
+    TimerHeapSet( index, obj );
+}
+
+static bool TimerQueueContains( TimerEvent_t *obj )
+{
+    return obj->HeapIndex >= 0;
+}
+
+static void TimerQueueInsert( TimerEvent_t *obj )
+{
+    if( TimerHeapSize >= TIMER_MAX_EVENTS )
+    {
+        // Not an assertion: release builds would write past the heap
+        error( "Timer queue full, raise TIMER_MAX_EVENTS\r\n" );
+        return;
+    }
+    TimerHeapSet( TimerHeapSize++, obj );
+    TimerHeapSiftUp( obj->HeapIndex );
+}
+
+static void TimerQueueRemove( TimerEvent_t *obj )
+{
+    uint8_t index = obj->HeapIndex;
+    TimerEvent_t *last = TimerHeap[--TimerHeapSize];
+
+    obj->HeapIndex = -1;
+    if( last != obj )
+    {
+        TimerHeapSet( index, last );
+        TimerHeapSiftUp( index );
+        TimerHeapSiftDown( last->HeapIndex );
+    }
+}
+
+static TimerEvent_t *TimerQueuePopExpired( TimerTime_t now )
+{
+    TimerEvent_t *obj;
+
+    if( ( TimerHeapSize == 0 ) || ( TimerHeap[0]->Timestamp > now ) )
+    {
+        return NULL;
+    }
+    obj = TimerHeap[0];
+    TimerQueueRemove( obj );
+    return obj;
+}
+
+static bool TimerQueueNextDeadline( TimerTime_t *deadline )
+{
+    if( TimerHeapSize == 0 )
+    {
+        return false;
+    }
+    *deadline = TimerHeap[0]->Timestamp;
+    return true;
+}
+
+#endif // TIMER_USE_WHEEL
+
+/*!
+ * \brief Arms the hardware timeout for the next queue deadline, or for the
+ *        next hop towards it
+ */
+static void TimerSetTimeout( void )
+{
+#if defined( TIMER_VIRTUAL_CLOCK )
+    TimerHwArmed = TimerQueueNextDeadline( &TimerHwDeadline );
+#else
+    TimerTime_t now = TimerGetCurrentTime( );
+    // Bounded from the last refresh, so restarting timers cannot defer it
+    TimerTime_t limit = TimerClock[TimerClockGeneration & 1].Time + TIMER_HW_MAX_HOP;
+
+    if( ( TimerQueueNextDeadline( &TimerHwDeadline ) == false ) || ( TimerHwDeadline > limit ) )
+    {
+        TimerHwDeadline = limit;
+    }
+    TimerHwArmed = true;
+    TimerHwTimeout.attach_us( &TimerIrqHandler, ( TimerHwDeadline > now ) ? ( uint32_t )( TimerHwDeadline - now ) : 0 );
+#endif
+}
+
+/*!
+ * \brief Hardware timeout handler, runs the callbacks of the expired timers
+ *
+ * \remark The queue is only touched with the interrupts disabled and the
+ *         callbacks run with them enabled, so interrupts of any priority
+ *         may start and stop timers, from their callbacks too.
+ */
+static void TimerIrqHandler( void )
+{
+    TimerEvent_t *obj;
+    void ( *callback )( void );
+    bool fired = false;
+    uint32_t primask;
+
+#if !defined( TIMER_VIRTUAL_CLOCK )
+    TimerClockUpdate( );
+#endif
+#if defined( TIMER_STATS )
+    TimerTime_t start = TimerGetCurrentTime( );
+#endif
+
+    primask = TimerEnterCritical( );
+    TimerWakeups++;
+    while( ( obj = TimerQueuePopExpired( TimerGetCurrentTime( ) ) ) != NULL )
+    {
+#if defined( TIMER_STATS )
+        TimerStatsRecord( obj, TimerGetCurrentTime( ) - obj->Timestamp, fired );
+#endif
+        fired = true;
+        if( ( obj->IsPeriodic == true ) && ( obj->ReloadValue > 0 ) )
+        {
+            obj->Timestamp += obj->ReloadValue;
+            TimerQueueInsert( obj );
+        }
+        callback = obj->Callback;
+        TimerExitCritical( primask );
+        if( callback != NULL )
+        {
+            callback( );
+        }
+        primask = TimerEnterCritical( );
+    }
+    if( fired == false )
+    {
+        TimerIntermediateWakeups++;
+    }
+#if defined( TIMER_STATS )
+    if( ( TimerGetCurrentTime( ) - start ) > TimerStatsMaxIsrDuration )
+    {
+        TimerStatsMaxIsrDuration = TimerGetCurrentTime( ) - start;
+    }
+#endif
+    TimerSetTimeout( );
+    TimerExitCritical( primask );
 }
 
 void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) )
 {
-    obj->value = 0;
+    obj->Timestamp = 0;
+    obj->ReloadValue = 0;
+    obj->IsPeriodic = false;
+#if defined( TIMER_USE_WHEEL )
+    obj->Next = NULL;
+    obj->Prev = NULL;
+    obj->Slot = 0;
+#else
+    obj->HeapIndex = -1;
+#endif
     obj->Callback = callback;
+#if defined( TIMER_STATS )
+    TimerStatsRegister( obj );
+#endif
 }
 
 void TimerStart( TimerEvent_t *obj )
 {
-    obj->Timer.attach_us( obj->Callback, obj->value );
+    TimerStartAt( obj, TimerGetCurrentTime( ) + obj->ReloadValue );
+}
+
+void TimerStartAt( TimerEvent_t *obj, TimerTime_t deadline )
+{
+    uint32_t primask = TimerEnterCritical( );
+
+    if( TimerQueueContains( obj ) == true )
+    {
+        TimerQueueRemove( obj );
+    }
+    obj->Timestamp = deadline;
+    TimerQueueInsert( obj );
+
+    if( ( TimerHwArmed == false ) || ( obj->Timestamp < TimerHwDeadline ) )
+    {
+        TimerSetTimeout( );
+    }
+    TimerExitCritical( primask );
 }
 
 void TimerStop( TimerEvent_t *obj )
 {
-    obj->Timer.detach( );
+    uint32_t primask = TimerEnterCritical( );
+
+    if( TimerQueueContains( obj ) == true )
+    {
+        TimerQueueRemove( obj );
+        if( obj->Timestamp == TimerHwDeadline )
+        {
+            TimerSetTimeout( );
+        }
+    }
+    TimerExitCritical( primask );
+}
+
+void TimerReset( TimerEvent_t *obj )
+{
+    TimerStop( obj );
+    TimerStart( obj );
+}
+
+void TimerSetValue( TimerEvent_t *obj, TimerTime_t value )
+{
+    obj->ReloadValue = value;
+}
+
+void TimerSetPeriodic( TimerEvent_t *obj, bool periodic )
+{
+    obj->IsPeriodic = periodic;
+}
+
+void TimerGetWakeupCount( uint32_t *total, uint32_t *intermediate )
+{
+    *total = TimerWakeups;
+    *intermediate = TimerIntermediateWakeups;
+}
+
+#if defined( TIMER_VIRTUAL_CLOCK )
+
+bool TimerVirtualClockRunNext( void )
+{
+    if( TimerHwArmed == false )
+    {
+        return false;
+    }
+    if( TimerHwDeadline > TimerVirtualTime )
+    {
+        TimerVirtualTime = TimerHwDeadline;
+    }
+    TimerIrqHandler( );
+    return true;
 }
 
-void TimerSetValue( TimerEvent_t *obj, uint32_t value )
+void TimerVirtualClockAdvance( TimerTime_t duration )
 {
-    obj->value = value;
+    TimerTime_t target = TimerVirtualTime + duration;
+
+    while( ( TimerHwArmed == true ) && ( TimerHwDeadline <= target ) )
+    {
+        TimerVirtualClockRunNext( );
+    }
+    TimerVirtualTime = target;
 }
+
+#endif // TIMER_VIRTUAL_CLOCK
+
+#if defined( TIMER_STATS )
+
+void TimerStatsGet( TimerEvent_t *obj, TimerStats_t *stats )
+{
+    uint32_t primask = TimerEnterCritical( );
+
+    *stats = obj->Stats;
+    TimerExitCritical( primask );
+}
+
+void TimerStatsGetDispatch( uint32_t *maxIsrDuration, uint32_t *overlaps )
+{
+    *maxIsrDuration = TimerStatsMaxIsrDuration;
+    *overlaps = TimerStatsOverlaps;
+}
+
+TimerEvent_t *TimerStatsNext( TimerEvent_t *obj )
+{
+    return ( obj == NULL ) ? TimerStatsList : obj->StatsNext;
+}
+
+void TimerStatsReset( void )
+{
+    uint32_t primask = TimerEnterCritical( );
+    TimerEvent_t *obj;
+
+    for( obj = TimerStatsList; obj != NULL; obj = obj->StatsNext )
+    {
+        memset1( ( uint8_t* )&obj->Stats, 0, sizeof( TimerStats_t ) );
+    }
+    TimerStatsMaxIsrDuration = 0;
+    TimerStatsOverlaps = 0;
+    TimerExitCritical( primask );
+}
+
+#endif // TIMER_STATS
@@ -18,26 +18,103 @@ Maintainer: Miguel Luis and Gregory Cristian
 #include "mbed.h"
 
 /*!
- * \brief Timer object description
+ * \brief Timer time variable definition
  */
-typedef struct TimerEvent_s
+#ifndef TimerTime_t
+typedef uint64_t TimerTime_t;
+#endif
+
+/*!
+ * \brief Timer queue implementation
+ *
+ * \remark By default running timers are kept in a fixed size min-heap of
+ *         TIMER_MAX_EVENTS entries. Defining TIMER_USE_WHEEL selects a
+ *         hierarchical timing wheel instead: unbounded number of timers and
+ *         O(1) start / stop, expiry in O(log n) of the timers due in the
+ *         same 1 ms tick, for host simulations running many devices; it
+ *         takes about 450 pointers of RAM.
+ */
+//#define TIMER_USE_WHEEL
+
+/*!
+ * \brief Timer clock source
+ *
+ * \remark By default the time is read from the free running microsecond
+ *         counter and the queue is served by a hardware timeout. Defining
+ *         TIMER_VIRTUAL_CLOCK selects a virtual clock for host simulations
+ *         instead: time only moves when TimerVirtualClockRunNext or
+ *         TimerVirtualClockAdvance is called, jumping straight from one timer
+ *         deadline to the next, and the callbacks run from those calls.
+ */
+//#define TIMER_VIRTUAL_CLOCK
+
+/*!
+ * \brief Maximum number of timer objects running at the same time
+ *
+ * \remark Running timers are kept in a fixed size queue served by a single
+ *         hardware timeout; each slot costs one pointer of RAM. Unused with
+ *         TIMER_USE_WHEEL.
+ */
+#ifndef TIMER_MAX_EVENTS
+#define TIMER_MAX_EVENTS                            16
+#endif
+
+/*!
+ * \brief Timer dispatch statistics
+ *
+ * \remark Defining TIMER_STATS records, for every timer, how late its
+ *         callbacks are dispatched compared with their deadline, and for the
+ *         timeout handler the longest run and the expiries dispatched behind
+ *         another one. Costs sizeof( TimerStats_t ) and a pointer per timer.
+ */
+//#define TIMER_STATS
+
+#if defined( TIMER_STATS )
+/*!
+ * Lateness histogram bins: bin 0 counts lateness below 8 us, bin i below
+ * 8 << i us, the last bin everything above
+ */
+#define TIMER_STATS_BINS                            12
+
+typedef struct TimerStats_s
 {
-    uint64_t value;
-    void ( *Callback )( void );
-    Ticker Timer;
-}TimerEvent_t;
+    uint32_t Count;                             //! Dispatched expiries
+    uint32_t Overlaps;                          //! Expiries dispatched behind another one in the same handler run
+    uint32_t MaxLateness;                       //! Largest lateness [us]
+    uint32_t Histogram[TIMER_STATS_BINS];       //! Lateness histogram
+}TimerStats_t;
+#endif
 
 /*!
- * \brief Timer time variable definition
+ * \brief Timer object description
  */
-#ifndef TimerTime_t
-typedef uint64_t TimerTime_t;
+typedef struct TimerEvent_s
+{
+    TimerTime_t Timestamp;          //! Expiration time [us], valid while running
+    TimerTime_t ReloadValue;        //! Timeout value [us], the period of a periodic timer
+    bool IsPeriodic;                //! Restarted from its deadline when it fires
+#if defined( TIMER_USE_WHEEL )
+    struct TimerEvent_s *Next;      //! Next timer in the same wheel slot
+    struct TimerEvent_s **Prev;     //! Link pointing to this timer, NULL when stopped
+    uint16_t Slot;                  //! Wheel level * 64 + slot, valid while running
+#else
+    int8_t HeapIndex;               //! Position in the timer queue, -1 when stopped
 #endif
+    void ( *Callback )( void );     //! Timer IRQ callback function
+#if defined( TIMER_STATS )
+    TimerStats_t Stats;             //! Dispatch statistics
+    struct TimerEvent_s *StatsNext; //! Next timer in the list of initialized timers
+#endif
+}TimerEvent_t;
 
 /*!
  * \brief Inializes the timer used to get current time.
  *
- * \remark Current time corresponds to the time since system startup
+ * \remark Current time corresponds to the time since system startup. It is
+ *         a monotonic 64 bit microsecond count derived from the free running
+ *         hardware counter, and can be read from any context. Also arms the
+ *         hardware timeout, which keeps the clock up to date without any
+ *         periodic interrupt.
  */
 void TimerTimeCounterInit( void );
 
@@ -55,10 +132,24 @@ void TimerInit( TimerEvent_t *obj, void ( *callback )( void ) );
 /*!
  * \brief Starts and adds the timer object to the list of timer events
  *
+ * \remark The timer fires ReloadValue after this call, once unless made
+ *         periodic. Starting a running timer restarts it.
+ *
  * \param [IN] obj Structure containing the timer object parameters
  */
 void TimerStart( TimerEvent_t *obj );
 
+/*!
+ * \brief Starts the timer object with an absolute deadline
+ *
+ * \remark A deadline already past fires at once. Starting a running timer
+ *         restarts it.
+ *
+ * \param [IN] obj      Structure containing the timer object parameters
+ * \param [IN] deadline Expiration time [us], in the TimerGetCurrentTime scale
+ */
+void TimerStartAt( TimerEvent_t *obj, TimerTime_t deadline );
+
 /*!
  * \brief Stops and removes the timer object from the list of timer events
  *
@@ -69,6 +160,9 @@ void TimerStop( TimerEvent_t *obj );
 /*!
  * \brief Resets the timer object
  *
+ * \remark Restarts the timer, ReloadValue after this call, whether it was
+ *         running or not.
+ *
  * \param [IN] obj Structure containing the timer object parameters
  */
 void TimerReset( TimerEvent_t *obj );
@@ -76,10 +170,36 @@ void TimerReset( TimerEvent_t *obj );
 /*!
  * \brief Set timer new timeout value
  *
+ * \remark Timeouts longer than the hardware timeout range are served by
+ *         chaining hardware timeouts (hops of at most 30 minutes), so the
+ *         value may span days.
+ *
  * \param [IN] obj   Structure containing the timer object parameters
- * \param [IN] value New timer timeout value
+ * \param [IN] value New timer timeout value [us]
+ */
+void TimerSetValue( TimerEvent_t *obj, TimerTime_t value );
+
+/*!
+ * \brief Makes the timer periodic or one-shot
+ *
+ * \remark A periodic timer is queued again, ReloadValue after the deadline
+ *         it fired for, before its callback runs; its period therefore does
+ *         not drift with the interrupt latency. Periods missed while the
+ *         timer could not be served fire back to back. TimerStop ends it.
+ *
+ * \param [IN] obj      Structure containing the timer object parameters
+ * \param [IN] periodic true for a periodic timer, false for one-shot (default)
  */
-void TimerSetValue( TimerEvent_t *obj, uint32_t value );
+void TimerSetPeriodic( TimerEvent_t *obj, bool periodic );
+
+/*!
+ * \brief Gets the number of hardware timeout wake ups since startup
+ *
+ * \param [OUT] total        All wake ups
+ * \param [OUT] intermediate Wake ups where no timer fired: hops of a long
+ *                           timeout, clock refreshes while no timer runs
+ */
+void TimerGetWakeupCount( uint32_t *total, uint32_t *intermediate );
 
 /*!
  * \brief Read the current time
@@ -104,4 +224,56 @@ TimerTime_t TimerGetElapsedTime( TimerTime_t savedTime );
  */
 TimerTime_t TimerGetFutureTime( TimerTime_t eventInFuture );
 
+#if defined( TIMER_STATS )
+/*!
+ * \brief Gets a consistent copy of the statistics of a timer
+ *
+ * \param [IN]  obj   Structure containing the timer object parameters
+ * \param [OUT] stats Statistics of the timer since TimerInit or TimerStatsReset
+ */
+void TimerStatsGet( TimerEvent_t *obj, TimerStats_t *stats );
+
+/*!
+ * \brief Gets the statistics of the timeout handler
+ *
+ * \param [OUT] maxIsrDuration Longest handler run, callbacks included [us]
+ * \param [OUT] overlaps       Expiries dispatched behind another one, all timers
+ */
+void TimerStatsGetDispatch( uint32_t *maxIsrDuration, uint32_t *overlaps );
+
+/*!
+ * \brief Walks the list of the initialized timers
+ *
+ * \param [IN] obj Previous timer, NULL to get the first one
+ * \retval next    Next timer, NULL at the end of the list
+ */
+TimerEvent_t *TimerStatsNext( TimerEvent_t *obj );
+
+/*!
+ * \brief Clears the statistics of all the timers and of the handler
+ */
+void TimerStatsReset( void );
+#endif
+
+#if defined( TIMER_VIRTUAL_CLOCK )
+/*!
+ * \brief Moves the virtual clock to the next timer deadline and runs the
+ *        callbacks of the timers due at that time
+ *
+ * \remark To be called when the application has nothing left to do. The
+ *         callbacks see the current time equal to their timer deadline.
+ *
+ * \retval running false if no timer is running, the clock is left unchanged
+ */
+bool TimerVirtualClockRunNext( void );
+
+/*!
+ * \brief Moves the virtual clock forward, running on the way the callbacks
+ *        of the timers due, in deadline order
+ *
+ * \param [IN] duration Time to move the clock by [us]
+ */
+void TimerVirtualClockAdvance( TimerTime_t duration );
+#endif
+
 #endif // __TIMER_H__
@@ -0,0 +1,422 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+    (C)2015 Semtech
+
+Description: Host benchmark of the timer queue: cost per timer operation
+             and expiry throughput with many concurrent timers
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+
+Maintainer: Miguel Luis and Gregory Cristian
+
+Only compiled when TIMER_BENCHMARK is defined, so the firmware build skips
+it. The mbed layer comes from host/: the ticker reads the host monotonic
+clock and the hardware timeout fires from sleep( ), which spins until it is
+due. From the repository root:
+
+    g++ -O2 -DTIMER_BENCHMARK -DTIMER_USE_WHEEL -Ihost -I. -Isystem \
+        system/timer_bench.cpp system/timer.cpp system/utilities.cpp \
+        host/mbed.cpp -o timer_bench
+
+    ./timer_bench [--timers N] [--ops N]
+
+Without TIMER_USE_WHEEL the heap queue is measured, limited to
+TIMER_MAX_EVENTS timers. With TIMER_VIRTUAL_CLOCK the expiry is driven by
+TimerVirtualClockRunNext, leaving out the host timer latency. The report
+gives:
+
+ - start:   queuing a stopped timer, N timers running
+ - restart: TimerStart on a running timer, N timers running
+ - stop:    TimerStop on a running timer, from N down to 0 timers running
+ - expiry:  N timers due at the same microsecond, from the first to the last
+            callback; covers the wake up, the dequeue and the callback
+
+Then N timers are started on distinct deadlines one microsecond apart and
+one in eight of them is stopped. Every other timer must fire exactly once,
+not before its deadline and in deadline order, and the stopped ones never.
+A violation, or an expiry missing one second after its deadline, ends the
+bench with a failure status.
+*/
+#if defined( TIMER_BENCHMARK )
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "board.h"
+
+/*!
+ * Default number of concurrent timers
+ */
+#define BENCH_TIMERS                                100000
+
+/*!
+ * Default number of restart operations
+ */
+#define BENCH_OPS                                   1000000
+
+/*!
+ * Timeout of the timers started by the operation measurements [us], long
+ * enough that none of them expires during the measurement
+ */
+#define BENCH_LONG_TIMEOUT                          600000000
+
+/*!
+ * Lead time of the expiry burst [us], plus 1 us per timer for the set up
+ */
+#define BENCH_EXPIRY_LEAD                           200000
+
+/*!
+ * Time an expiry may lag its deadline before it counts as missing [us]
+ */
+#define BENCH_EXPIRY_GRACE                          1000000
+
+/*!
+ * One timer in BENCH_CHECK_STOP_RATIO is stopped by the check
+ */
+#define BENCH_CHECK_STOP_RATIO                      8
+
+static TimerEvent_t *Timers;
+static volatile uint32_t Fired = 0;
+static uint64_t FirstFiredNs = 0;
+static uint64_t LastFiredNs = 0;
+
+/*!
+ * Timers the check expects to fire, in deadline order, and the expiries seen
+ */
+static bool Checking = false;
+static TimerEvent_t **CheckOrder;
+static uint32_t CheckCount = 0;
+static volatile uint32_t CheckFired = 0;
+static uint32_t CheckViolations = 0;
+
+#if !defined( TIMER_VIRTUAL_CLOCK )
+static volatile bool WatchdogExpired = false;
+#endif
+
+static uint64_t NowNs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t )ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t Random( void )
+{
+    static uint32_t state = 2463534242u;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void OnCheckEvent( void );
+
+static void OnTimerEvent( void )
+{
+    uint64_t now = NowNs( );
+
+    if( Checking == true )
+    {
+        OnCheckEvent( );
+        return;
+    }
+    if( Fired == 0 )
+    {
+        FirstFiredNs = now;
+    }
+    LastFiredNs = now;
+    Fired = Fired + 1;
+}
+
+/*!
+ * \brief Tells whether a timer is queued, from the fields of the queue in use
+ */
+static bool IsRunning( TimerEvent_t *obj )
+{
+#if defined( TIMER_USE_WHEEL )
+    return obj->Prev != NULL;
+#else
+    return obj->HeapIndex >= 0;
+#endif
+}
+
+static void CheckViolation( const char *what, uint32_t expiry )
+{
+    if( CheckViolations++ < 10 )
+    {
+        fprintf( stderr, "check: %s, expiry %u\n", what, expiry );
+    }
+}
+
+/*!
+ * \brief Callback of the checked timers. The deadlines are distinct, so the
+ *        expiry k must be the k-th timer of CheckOrder, which the queue has
+ *        just dequeued; any other timer firing leaves that one queued.
+ */
+static void OnCheckEvent( void )
+{
+    uint32_t expiry = CheckFired;
+    TimerEvent_t *expected;
+
+    CheckFired = expiry + 1;
+    if( expiry >= CheckCount )
+    {
+        CheckViolation( "extra expiry", expiry );
+        return;
+    }
+    expected = CheckOrder[expiry];
+    if( IsRunning( expected ) == true )
+    {
+        CheckViolation( "fired out of deadline order, twice or after TimerStop", expiry );
+    }
+    else if( TimerGetCurrentTime( ) < expected->Timestamp )
+    {
+        CheckViolation( "fired before its deadline", expiry );
+    }
+}
+
+#if !defined( TIMER_VIRTUAL_CLOCK )
+static void OnWatchdog( void )
+{
+    WatchdogExpired = true;
+}
+#endif
+
+/*!
+ * \brief Serves the timers until count expiries were seen
+ *
+ * \param [IN] fired Expiry counter
+ * \param [IN] count Expiries to wait for
+ * \param [IN] limit Time to give up at [us]
+ * \retval done      false if the expiries were still missing at limit
+ */
+static bool WaitExpiries( volatile uint32_t *fired, uint32_t count, TimerTime_t limit )
+{
+#if defined( TIMER_VIRTUAL_CLOCK )
+    while( *fired < count )
+    {
+        if( ( TimerVirtualClockRunNext( ) == false ) || ( TimerGetCurrentTime( ) > limit ) )
+        {
+            return false;
+        }
+    }
+    return true;
+#else
+    // The timer module keeps its hardware timeout armed up to 30 minutes
+    // ahead; a timeout of our own bounds the wait
+    Timeout watchdog;
+    TimerTime_t now = TimerGetCurrentTime( );
+
+    WatchdogExpired = false;
+    watchdog.attach_us( &OnWatchdog, ( limit > now ) ? ( uint32_t )( limit - now ) : 0 );
+    while( ( *fired < count ) && ( WatchdogExpired == false ) )
+    {
+        sleep( );
+    }
+    watchdog.detach( );
+    return *fired >= count;
+#endif
+}
+
+/*!
+ * \brief Runs the expiry check on count timers
+ *
+ * \retval ok false on any violation
+ */
+static bool Check( uint32_t count )
+{
+    TimerTime_t base;
+    uint32_t *slots;
+    uint32_t i, j, tmp;
+
+    slots = ( uint32_t* )malloc( count * sizeof( uint32_t ) );
+    CheckOrder = ( TimerEvent_t** )malloc( count * sizeof( TimerEvent_t* ) );
+    if( ( slots == NULL ) || ( CheckOrder == NULL ) )
+    {
+        return false;
+    }
+
+    // Deadline slot of each timer, shuffled so the start order is random
+    for( i = 0; i < count; i++ )
+    {
+        slots[i] = i;
+    }
+    for( i = count - 1; i > 0; i-- )
+    {
+        j = Random( ) % ( i + 1 );
+        tmp = slots[i];
+        slots[i] = slots[j];
+        slots[j] = tmp;
+    }
+
+    // The timers keep their callback: TimerInit is O(n) with TIMER_STATS
+    Checking = true;
+    base = TimerGetCurrentTime( ) + BENCH_EXPIRY_LEAD + count;
+    for( i = 0; i < count; i++ )
+    {
+        TimerStartAt( &Timers[i], base + slots[i] );
+        CheckOrder[slots[i]] = &Timers[i];
+    }
+    for( i = 0; i < count; i++ )
+    {
+        if( ( Random( ) % BENCH_CHECK_STOP_RATIO ) == 0 )
+        {
+            TimerStop( &Timers[i] );
+            CheckOrder[slots[i]] = NULL;
+        }
+    }
+    if( TimerGetCurrentTime( ) >= base )
+    {
+        fprintf( stderr, "check set up overran the first deadline\n" );
+        return false;
+    }
+
+    // Expected expiries, in deadline order
+    for( i = 0, CheckCount = 0; i < count; i++ )
+    {
+        if( CheckOrder[i] != NULL )
+        {
+            CheckOrder[CheckCount++] = CheckOrder[i];
+        }
+    }
+
+    if( WaitExpiries( &CheckFired, CheckCount, base + count + BENCH_EXPIRY_GRACE ) == false )
+    {
+        CheckViolation( "missing expiry", CheckFired );
+    }
+    for( i = 0; i < count; i++ )
+    {
+        if( IsRunning( &Timers[i] ) == true )
+        {
+            CheckViolation( "timer still queued after the last deadline", CheckFired );
+            break;
+        }
+    }
+    printf( "check    %10u expiries, %u stopped timers: %s\n", CheckCount, count - CheckCount,
+            ( CheckViolations == 0 ) ? "ok" : "FAILED" );
+
+    free( slots );
+    free( CheckOrder );
+    return CheckViolations == 0;
+}
+
+static void Report( const char *name, uint32_t count, uint64_t ns )
+{
+    printf( "%-8s %10u %12.1f %14.0f\n", name, count, ( double )ns / count,
+            ( ns > 0 ) ? count * 1e9 / ns : 0.0 );
+}
+
+static void Usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [--timers N] [--ops N]\n", name );
+}
+
+int main( int argc, char **argv )
+{
+    uint32_t count = BENCH_TIMERS;
+    uint32_t ops = BENCH_OPS;
+    TimerTime_t deadline;
+    uint64_t t0;
+    uint32_t i;
+    int a;
+
+    for( a = 1; a < argc; a++ )
+    {
+        if( ( strcmp( argv[a], "--timers" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            count = strtoul( argv[++a], NULL, 0 );
+        }
+        else if( ( strcmp( argv[a], "--ops" ) == 0 ) && ( a + 1 < argc ) )
+        {
+            ops = strtoul( argv[++a], NULL, 0 );
+        }
+        else
+        {
+            Usage( argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+#if !defined( TIMER_USE_WHEEL )
+    if( count > TIMER_MAX_EVENTS )
+    {
+        count = TIMER_MAX_EVENTS;
+    }
+#endif
+    if( ( count == 0 ) || ( ops == 0 ) )
+    {
+        Usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    Timers = ( TimerEvent_t* )malloc( count * sizeof( TimerEvent_t ) );
+    if( Timers == NULL )
+    {
+        return EXIT_FAILURE;
+    }
+    TimerTimeCounterInit( );
+    for( i = 0; i < count; i++ )
+    {
+        TimerInit( &Timers[i], OnTimerEvent );
+        TimerSetValue( &Timers[i], BENCH_LONG_TIMEOUT + Random( ) % BENCH_LONG_TIMEOUT );
+    }
+
+    printf( "%-8s %10s %12s %14s\n", "op", "count", "ns/op", "ops/s" );
+
+    t0 = NowNs( );
+    for( i = 0; i < count; i++ )
+    {
+        TimerStart( &Timers[i] );
+    }
+    Report( "start", count, NowNs( ) - t0 );
+
+    t0 = NowNs( );
+    for( i = 0; i < ops; i++ )
+    {
+        TimerStart( &Timers[Random( ) % count] );
+    }
+    Report( "restart", ops, NowNs( ) - t0 );
+
+    t0 = NowNs( );
+    for( i = 0; i < count; i++ )
+    {
+        TimerStop( &Timers[i] );
+    }
+    Report( "stop", count, NowNs( ) - t0 );
+
+    // Every timer gets the value that makes it due at the same deadline
+    deadline = TimerGetCurrentTime( ) + BENCH_EXPIRY_LEAD + count;
+    for( i = 0; i < count; i++ )
+    {
+        TimerSetValue( &Timers[i], deadline - TimerGetCurrentTime( ) );
+        TimerStart( &Timers[i] );
+    }
+    if( TimerGetCurrentTime( ) >= deadline )
+    {
+        fprintf( stderr, "expiry set up overran the deadline\n" );
+        return EXIT_FAILURE;
+    }
+    if( WaitExpiries( &Fired, count, deadline + BENCH_EXPIRY_GRACE ) == false )
+    {
+        fprintf( stderr, "expiry: %u of %u timers fired\n", Fired, count );
+        return EXIT_FAILURE;
+    }
+    Report( "expiry", count, LastFiredNs - FirstFiredNs );
+
+    if( Check( count ) == false )
+    {
+        return EXIT_FAILURE;
+    }
+
+    free( Timers );
+    return EXIT_SUCCESS;
+}
+
+#endif // TIMER_BENCHMARK